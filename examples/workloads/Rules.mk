@@ -14,9 +14,19 @@ epp-inst: .setup.done .epp-inst.done
 	@echo "EPP-INST"
 	cd $(FUNCTION) && \
 	export PATH=$(LLVM_OBJ):$(PATH) && \
-		$(NEEDLE_OBJ)/epp $(LDFLAGS) -L$(NEEDLE_LIB) -epp-fn=$(FUNCTION) $(NAME).bc -o $(NAME)-epp $(LIBS) 2> ../epp-inst.log
+		$(NEEDLE_OBJ)/epp $(LDFLAGS) -L$(NEEDLE_LIB) -epp-fn=$(FUNCTION) -epp-cache=$(NAME).epp-cache $(NAME).bc -o $(NAME)-epp $(LIBS) 2> ../epp-inst.log
 	@touch .epp-inst.done
 
+epp-rank: .setup.done .prerun.done .epp-rank.done
+.epp-rank.done: .setup.done .prerun.done
+	@echo "EPP-RANK"
+	cd $(FUNCTION) && \
+	export PATH=$(LLVM_OBJ):$(PATH) && \
+		$(NEEDLE_OBJ)/epp $(LDFLAGS) -L$(NEEDLE_LIB) -rank $(NAME).bc -o $(NAME)-rank $(LIBS) 2> ../epp-rank.log && \
+	export LD_LIBRARY_PATH=$(NEEDLE_LIB):/usr/local/lib64 && \
+	./$(NAME)-rank $(RUNCMD) 2>&1 > ../epp-rank-run.log
+	@touch .epp-rank.done
+
 prerun: .setup.done 
 .prerun.done: .setup.done 
 ifdef PRERUN
@@ -45,7 +55,7 @@ epp-decode: .epp-run.done .epp-decode.done
 	@echo "EPP-DECODE"
 	cd $(FUNCTION) && \
 	export PATH=$(LLVM_OBJ):$(PATH) && \
-    $(NEEDLE_OBJ)/epp -epp-fn=$(FUNCTION) $(NAME).bc -p=path-profile-results.txt 2> ../epp-decode.log
+    $(NEEDLE_OBJ)/epp -epp-fn=$(FUNCTION) -epp-cache=$(NAME).epp-cache $(NAME).bc -p=path-profile-results.txt 2> ../epp-decode.log
 	@touch .epp-decode.done
 
 needle-path: .epp-decode.done .needle-path.done
@@ -53,7 +63,7 @@ needle-path: .epp-decode.done .needle-path.done
 	@echo "NEEDLE-PATH"
 	cd $(FUNCTION) && \
 	export PATH=$(LLVM_OBJ):$(PATH) && \
-    python $(ROOT)/examples/scripts/path.py epp-sequences.txt > paths.stats.txt && \
+    $(NEEDLE_OBJ)/needle-select -path epp-sequences.txt > paths.stats.txt && \
 	$(NEEDLE_OBJ)/needle -fn=$(FUNCTION) -ExtractType::path -slog -seq=path-seq-0.txt $(LIBS) -u=$(HELPER_LIB) $(NAME).bc -o $(NAME)-needle-0 2>&1 > ../needle-path.log
 
 needle-braid: .epp-decode.done .needle-braid.done
@@ -61,7 +71,7 @@ needle-braid: .epp-decode.done .needle-braid.done
 	@echo "NEEDLE-BRAID"
 	cd $(FUNCTION) && \
 	export PATH=$(LLVM_OBJ):$(PATH) && \
-    python $(ROOT)/examples/scripts/braid.py epp-sequences.txt > braids.stats.txt && \
+    $(NEEDLE_OBJ)/needle-select -braid epp-sequences.txt > braids.stats.txt && \
 	$(NEEDLE_OBJ)/needle -fn=$(FUNCTION) -ExtractType::braid -seq=braid-seq-0.txt $(LIBS) -u=$(HELPER_LIB) $(NAME).bc -o $(NAME)-needle-0 2>&1 > ../needle-braid.log
 
 needle-run-braid: needle-braid prerun .prerun.done
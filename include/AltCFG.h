@@ -13,6 +13,8 @@
 #include <memory>
 #include <set>
 
+#include "PathId.h"
+
 using namespace llvm;
 using namespace std;
 
@@ -24,69 +26,99 @@ namespace epp {
 
 typedef pair<BasicBlock *, BasicBlock *> Edge;
 typedef SetVector<Edge> EdgeListTy;
-typedef SetVector<BasicBlock *, vector<BasicBlock *>, DenseSet<BasicBlock *>>
-    SuccListTy;
-typedef MapVector<const BasicBlock *, SuccListTy> CFGTy;
-typedef MapVector<Edge, pair<Edge, Edge>> FakeTableTy;
-typedef DenseMap<const BasicBlock *, SmallVector<BasicBlock *, 4>> SuccCacheTy;
-typedef MapVector<Edge, APInt> EdgeWtMapTy;
+typedef SmallVector<BasicBlock *, 4> AdjListTy;
 
-class altcfg {
+// Successors and predecessors of a block in the alternate CFG.
+struct AdjTy {
+    AdjListTy Succs;
+    AdjListTy Preds;
+};
 
+typedef MapVector<const BasicBlock *, AdjTy> CFGTy;
+typedef MapVector<Edge, pair<Edge, Edge>> FakeTableTy;
+template <typename PathIdTy> using EdgeWtMapTy = MapVector<Edge, PathIdTy>;
+
+// The alternate CFG is parameterized by the type used for path ids, edge
+// weights and increments, see PathId.h. It is instantiated for uint64_t and
+// WidePathIdTy.
+template <typename PathIdTy> class altcfg {
+    typedef PathIdTraits<PathIdTy> Traits;
+
+    // Edges of the alternate CFG, i.e real edges which are not segmented
+    // and the fake edges which replace the segmented ones. Along with the
+    // adjacency lists in CFG and FakeEdges, this is kept up to date by add()
+    // so that none of the queries need to rebuild the graph.
     EdgeListTy Edges;
-    EdgeWtMapTy Weights;
+    EdgeListTy FakeEdges;
+    EdgeWtMapTy<PathIdTy> Weights;
     CFGTy CFG;
-    SuccCacheTy SuccCache;
 
-    EdgeListTy get() const;
+    void insertEdge(const Edge &);
+    const EdgeListTy &get() const { return Edges; }
     EdgeListTy getSpanningTree(BasicBlock *);
-    void spanningHelper(BasicBlock *, EdgeListTy &, DenseSet<BasicBlock *> &);
     EdgeListTy getChords(EdgeListTy &) const;
-    void computeIncrement(EdgeWtMapTy &, BasicBlock *, BasicBlock *,
+    void computeIncrement(EdgeWtMapTy<PathIdTy> &, BasicBlock *, BasicBlock *,
                           EdgeListTy &, EdgeListTy &);
-    void initWt(const Edge, const APInt);
+    void initWt(const Edge &E) { Weights[E] = Traits::get(0); }
 
   protected:
     FakeTableTy SegmentMap;
-    EdgeWtMapTy getIncrements(BasicBlock *, BasicBlock *);
+    EdgeWtMapTy<PathIdTy> getIncrements(BasicBlock *, BasicBlock *);
 
   public:
     bool add(BasicBlock *Src, BasicBlock *Tgt, BasicBlock *Entry = nullptr,
              BasicBlock *Exit = nullptr);
-    APInt &operator[](const Edge &);
+    PathIdTy &operator[](const Edge &);
     void print(raw_ostream &os = errs()) const;
     void dot(raw_ostream &os = errs()) const;
-    SmallVector<BasicBlock *, 4> succs(const BasicBlock *);
+    const AdjListTy &succs(const BasicBlock *) const;
+    const AdjListTy &preds(const BasicBlock *) const;
+    size_t size() const { return CFG.size(); }
     void clear() {
-        Edges.clear(), Weights.clear(), CFG.clear();
-        SuccCache.clear();
+        Edges.clear(), FakeEdges.clear(), Weights.clear(), CFG.clear();
+        SegmentMap.clear();
     }
-    EdgeListTy getFakeEdges() const;
+    bool contains(const BasicBlock *B) const { return CFG.count(B); }
+    const EdgeListTy &getFakeEdges() const { return FakeEdges; }
+    const EdgeListTy &getEdges() const { return Edges; }
+    const FakeTableTy &getSegments() const { return SegmentMap; }
 };
 
-typedef std::tuple<bool, APInt, bool, APInt> InstValTy;
+template <typename PathIdTy>
+using InstValTy = std::tuple<bool, PathIdTy, bool, PathIdTy>;
 
-class CFGInstHelper : public altcfg {
-    EdgeWtMapTy Inc;
+template <typename PathIdTy> class CFGInstHelper : public altcfg<PathIdTy> {
+    typedef PathIdTraits<PathIdTy> Traits;
+    EdgeWtMapTy<PathIdTy> Inc;
 
   public:
-    CFGInstHelper(altcfg &A, BasicBlock *B, BasicBlock *C) : altcfg(A) {
-        Inc = getIncrements(B, C);
+    CFGInstHelper(altcfg<PathIdTy> &A, BasicBlock *B, BasicBlock *C)
+        : altcfg<PathIdTy>(A) {
+        Inc = this->getIncrements(B, C);
     }
 
-    InstValTy get(Edge E) const {
+    InstValTy<PathIdTy> get(Edge E) const {
 
-        auto getInc = [this](const Edge E) -> APInt {
+        auto getInc = [this](const Edge E) -> PathIdTy {
             if (Inc.count(E))
                 return Inc.lookup(E);
-            return APInt(128, 0, true);
+            return Traits::get(0);
         };
 
-        if (SegmentMap.count(E)) {
-            auto F = SegmentMap.lookup(E);
+        if (this->SegmentMap.count(E)) {
+            auto F = this->SegmentMap.lookup(E);
+            // An edge leaving a collapsed region only starts a new path, the
+            // path was logged when the region was entered.
+            if (!SRC(F.first))
+                return make_tuple(true, getInc(F.second), false,
+                                  Traits::get(0));
             return make_tuple(true, getInc(F.first), true, getInc(F.second));
         }
-        return make_tuple(true, getInc(E), false, APInt(128, 0, true));
+        // Edges within a collapsed region are not instrumented, the chord
+        // (Exit, Entry) is not an edge of the CFG but has an increment.
+        if (!this->getEdges().count(E) && !Inc.count(E))
+            return make_tuple(false, Traits::get(0), false, Traits::get(0));
+        return make_tuple(true, getInc(E), false, Traits::get(0));
     }
 };
 }
@@ -12,6 +12,8 @@
 #include "llvm/IR/Module.h"
 #include "llvm/Support/CommandLine.h"
 
+#include <algorithm>
+#include <functional>
 #include <map>
 #include <sstream>
 #include <string>
@@ -41,6 +43,7 @@ void breakCritEdges(llvm::Module &, llvm::StringRef);
 void breakCritEdges(llvm::Function &);
 void printCFG(llvm::Function &);
 bool checkIntrinsic(llvm::CallSite &);
+bool isAcceleratable(llvm::BasicBlock *);
 bool isSelfLoop(const llvm::BasicBlock *);
 llvm::SetVector<llvm::Loop *> getLoops(llvm::LoopInfo *);
 void writeModule(llvm::Module *, std::string);
@@ -51,6 +54,37 @@ void labelUID(llvm::Function &);
 vector<BasicBlock *> postOrder(Function &, LoopInfo *);
 void runStatsPasses(Function &);
 void printPathSrc(SetVector<llvm::BasicBlock *> &, raw_ostream &out = errs());
+unsigned getNumThreads(unsigned);
+void parallelFor(size_t, unsigned, std::function<void(size_t, size_t)>);
+
+// Sort with NumThreads threads, the slices are sorted in parallel and then
+// merged pairwise, each round of merges also runs in parallel.
+template <typename It, typename Cmp>
+void parallelSort(It Begin, It End, unsigned NumThreads, Cmp Less) {
+    size_t N = End - Begin;
+    NumThreads = getNumThreads(NumThreads);
+    if (NumThreads == 1 || N < 2 * NumThreads) {
+        std::sort(Begin, End, Less);
+        return;
+    }
+    size_t Chunk = (N + NumThreads - 1) / NumThreads;
+    parallelFor(NumThreads, NumThreads, [&](size_t B, size_t E) {
+        for (size_t I = B; I < E; I++)
+            std::sort(Begin + std::min(N, I * Chunk),
+                      Begin + std::min(N, (I + 1) * Chunk), Less);
+    });
+    for (; Chunk < N; Chunk *= 2) {
+        size_t Merges = (N + 2 * Chunk - 1) / (2 * Chunk);
+        parallelFor(Merges, NumThreads, [&](size_t B, size_t E) {
+            for (size_t I = B; I < E; I++) {
+                auto Lo = std::min(N, 2 * I * Chunk),
+                     Mid = std::min(N, (2 * I + 1) * Chunk),
+                     Hi  = std::min(N, (2 * I + 2) * Chunk);
+                std::inplace_merge(Begin + Lo, Begin + Mid, Begin + Hi, Less);
+            }
+        });
+    }
+}
 }
 
 namespace helpers {
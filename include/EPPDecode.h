@@ -2,17 +2,101 @@
 #define EPPDECODE_H
 
 #include "llvm/ADT/APInt.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/InstrTypes.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Pass.h"
 
 #include "EPPEncode.h"
+#include <fstream>
+#include <istream>
 #include <map>
 #include <vector>
 
 namespace epp {
 enum PathType { RIRO, FIRO, RIFO, FIFO };
+
+// Blocks of a decoded path without the endpoints of its fake edges.
+template <typename BlockTy>
+std::vector<BlockTy>
+trimPath(const std::pair<PathType, std::vector<BlockTy>> &Path) {
+    int start = 0, end = 0;
+    switch (Path.first) {
+    case RIRO:
+        break;
+    case FIRO:
+        start = 1;
+        break;
+    case RIFO:
+        end = 1;
+        break;
+    case FIFO:
+        start = 1;
+        end   = 1;
+        break;
+    }
+    return std::vector<BlockTy>(Path.second.begin() + start,
+                                Path.second.end() - end);
+}
+
+// True if the block returns or ends in unreachable, the paths which end
+// there are not followed by another one.
+inline bool isFunctionExiting(const llvm::BasicBlock *BB) {
+    return BB->getTerminator()->getNumSuccessors() == 0;
+}
+
+// The properties of a block needed to check paths, computed once per block
+// so that checking a path does not walk the IR. Cost is the number of
+// instructions which do work, i.e not phis, debug intrinsics or
+// unconditional branches.
+struct BlockSummary {
+    bool Acceleratable;
+    uint64_t NumIns;
+    uint64_t Cost;
+};
+
+BlockSummary summarizeBlock(llvm::BasicBlock *);
+
+// Number of instructions on the path, 0 if it cannot be accelerated.
+uint64_t pathCheck(std::vector<llvm::BasicBlock *> &);
+
+void printPath(std::vector<llvm::BasicBlock *> &, std::ofstream &);
+
+// Flat copy of the alternate CFG built once per function for decoding.
+// Blocks are numbered and the out edges of block I are stored in
+// [Begin[I], Begin[I + 1]) sorted by weight, so that each step of decoding
+// is a binary search for the largest weight which does not exceed the rest
+// of the path id. Edges with equal weights keep their order in the ACFG.
+// Decoded paths are sequences of block numbers, which are checked with the
+// summary of each block.
+template <typename PathIdTy> struct DecodeTable {
+    std::vector<llvm::BasicBlock *> Blocks;
+    std::vector<BlockSummary> Summary;
+    // Numbers given to the blocks by Namer.
+    std::vector<uint32_t> Ids;
+    std::vector<bool> Exiting;
+    std::vector<unsigned> Begin;
+    std::vector<PathIdTy> Weights;
+    std::vector<unsigned> Succs;
+    std::vector<bool> Fake;
+    unsigned Entry;
+
+    DecodeTable(llvm::Function &F, Encoding<PathIdTy> &E);
+
+    // Same as epp::pathCheck for a path of block numbers.
+    uint64_t pathCheck(const std::vector<unsigned> &Path) const {
+        uint64_t NumIns = 0;
+        for (auto B : Path) {
+            if (!Summary[B].Acceleratable)
+                return 0;
+            NumIns += Summary[B].NumIns;
+        }
+        return NumIns;
+    }
+};
+
 struct EPPDecode : public llvm::ModulePass {
     static char ID;
     llvm::StringRef filename;
@@ -26,8 +110,18 @@ struct EPPDecode : public llvm::ModulePass {
 
     virtual bool runOnModule(llvm::Module &m) override;
 
-    std::pair<PathType, std::vector<llvm::BasicBlock *>>
-    decode(llvm::Function &f, llvm::APInt pathID, EPPEncode &E);
+    template <typename PathIdTy>
+    void decodeProfile(llvm::Function &F, Encoding<PathIdTy> &E,
+                       llvm::LoopInfo &LI, std::istream &inFile);
+
+    // Decode an RLE trace of the paths in a single pass, see -trace.
+    template <typename PathIdTy>
+    void decodeTrace(llvm::Function &F, Encoding<PathIdTy> &E,
+                     llvm::LoopInfo &LI, std::istream &inFile);
+
+    template <typename PathIdTy>
+    static std::pair<PathType, std::vector<unsigned>>
+    decode(PathIdTy pathID, const DecodeTable<PathIdTy> &T);
 };
 }
 
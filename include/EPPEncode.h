@@ -3,6 +3,7 @@
 
 #include "llvm/ADT/APInt.h"
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/MapVector.h"
 #include "llvm/ADT/SetVector.h"
 #include "llvm/Analysis/LoopInfo.h"
@@ -16,18 +17,62 @@
 #include <unordered_map>
 
 #include "AltCFG.h"
+#include "EncodingCache.h"
 
 namespace epp {
 
+// The number of paths from each block and the alternate CFG with edge
+// weights, computed with path ids of type PathIdTy. Entry and Exit are the
+// endpoints of the fake edges which replace the segmented edges. Collapsed
+// blocks are left out of the alternate CFG, paths end when they enter a
+// collapsed region and start again when they leave it.
+template <typename PathIdTy> struct Encoding {
+    llvm::DenseMap<llvm::BasicBlock *, PathIdTy> numPaths;
+    altcfg<PathIdTy> ACFG;
+    llvm::BasicBlock *Entry, *Exit;
+    llvm::DenseSet<llvm::BasicBlock *> Collapsed;
+
+    Encoding() : Entry(nullptr), Exit(nullptr) {}
+
+    void clear() {
+        numPaths.clear();
+        ACFG.clear();
+        Entry = Exit = nullptr;
+        Collapsed.clear();
+    }
+};
+
+// Estimate the number of paths through F in double precision, without
+// building the encoding. Used to compare the cost of profiling functions.
+double estimatePaths(llvm::Function &F, llvm::LoopInfo *LI);
+
 struct EPPEncode : public llvm::FunctionPass {
 
     static char ID;
 
     llvm::LoopInfo *LI;
-    llvm::DenseMap<llvm::BasicBlock *, llvm::APInt> numPaths;
-    altcfg ACFG;
 
-    EPPEncode() : llvm::FunctionPass(ID), LI(nullptr) {}
+    // The encoding uses 64 bit path ids unless the number of paths does not
+    // fit or a wide counter is requested, in which case WidePathIdTy is used.
+    bool isWide;
+    Encoding<uint64_t> Narrow;
+    Encoding<WidePathIdTy> Wide;
+
+    // Encodings read from and written to the -epp-cache file.
+    EncodingCacheTy Cache;
+    bool CacheDirty;
+
+    EPPEncode()
+        : llvm::FunctionPass(ID), LI(nullptr), isWide(false),
+          CacheDirty(false) {}
+
+    // Invoke F with the encoding which is in use for the current function.
+    template <typename Fn> void visit(Fn F) {
+        if (isWide)
+            F(Wide);
+        else
+            F(Narrow);
+    }
 
     virtual void getAnalysisUsage(llvm::AnalysisUsage &au) const override {
         au.addRequired<llvm::LoopInfoWrapperPass>();
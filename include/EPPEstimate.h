@@ -0,0 +1,37 @@
+#ifndef EPPESTIMATE_H
+#define EPPESTIMATE_H
+
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+
+#include "EPPEncode.h"
+
+#include <fstream>
+
+namespace epp {
+
+// Estimate the frequency of the paths of the encoding from the static branch
+// probabilities and block frequencies, without a profiling run. The most
+// likely paths are written to epp-sequences.txt in the same format as
+// EPPDecode, with the counts scaled to a million calls of the function.
+struct EPPEstimate : public llvm::ModulePass {
+    static char ID;
+
+    EPPEstimate() : llvm::ModulePass(ID) {}
+
+    virtual void getAnalysisUsage(llvm::AnalysisUsage &au) const override {
+        au.addRequired<EPPEncode>();
+    }
+
+    virtual bool runOnModule(llvm::Module &m) override;
+
+    template <typename PathIdTy>
+    void estimate(llvm::Function &F, Encoding<PathIdTy> &E,
+                  llvm::LoopInfo &LI, std::ofstream &Outfile);
+
+    const char *getPassName() const override { return "PASHA - EPPEstimate"; }
+};
+}
+
+#endif
@@ -20,7 +20,8 @@ struct EPPProfile : public llvm::ModulePass {
     }
 
     virtual bool runOnModule(llvm::Module &m) override;
-    void instrument(llvm::Function &F, EPPEncode &E);
+    template <typename PathIdTy>
+    void instrument(llvm::Function &F, Encoding<PathIdTy> &E);
 
     bool doInitialization(llvm::Module &m);
     bool doFinalization(llvm::Module &m);
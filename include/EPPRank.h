@@ -0,0 +1,28 @@
+#ifndef EPPRANK_H
+#define EPPRANK_H
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+
+namespace epp {
+
+// Instrument every defined function of the module to rank them by execution
+// time. The runtime (RuntimeRank.cpp) counts the calls to each function and
+// samples a shadow stack of the instrumented functions to estimate their
+// inclusive and exclusive time. The estimated number of paths is embedded
+// in the binary so that the report shows the cost of profiling each function.
+struct EPPRank : public llvm::ModulePass {
+    static char ID;
+
+    EPPRank() : llvm::ModulePass(ID) {}
+
+    virtual void getAnalysisUsage(llvm::AnalysisUsage &au) const override {
+        au.addRequired<llvm::LoopInfoWrapperPass>();
+    }
+
+    virtual bool runOnModule(llvm::Module &m) override;
+    const char *getPassName() const override { return "PASHA - EPPRank"; }
+};
+}
+
+#endif
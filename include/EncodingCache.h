@@ -0,0 +1,36 @@
+#ifndef ENCODINGCACHE_H
+#define ENCODINGCACHE_H
+
+#include "llvm/ADT/StringRef.h"
+
+#include <map>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace epp {
+
+// Serialized encoding of a single function. Blocks are referred to by name
+// and values are hex strings so that the entry does not depend on the width
+// of the path ids. Hash is computed over the preprocessed function and the
+// options which affect the encoding.
+struct EncodingCacheEntry {
+    std::string Hash;
+    bool Wide;
+    // Real edges which were replaced by fake edges.
+    std::vector<std::pair<std::string, std::string>> Segments;
+    std::vector<std::pair<std::string, std::string>> NumPaths;
+    std::vector<std::tuple<std::string, std::string, std::string>> Weights;
+
+    EncodingCacheEntry() : Wide(false) {}
+};
+
+// Cache entries keyed by function name.
+typedef std::map<std::string, EncodingCacheEntry> EncodingCacheTy;
+
+bool readEncodingCache(llvm::StringRef, EncodingCacheTy &);
+void writeEncodingCache(llvm::StringRef, const EncodingCacheTy &);
+}
+
+#endif
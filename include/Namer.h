@@ -15,6 +15,10 @@ using namespace llvm;
 
 namespace epp {
 
+// Namer gives a name to the unnamed blocks of the target function and
+// numbers its blocks in layout order. The number is attached to the
+// terminator of the block as metadata, so that files can refer to blocks by
+// number (see Sequences.h) and tools can map the numbers back with an array.
 struct Namer : public ModulePass {
     static char ID;
 
@@ -28,6 +32,9 @@ struct Namer : public ModulePass {
 
     void getAnalysisUsage(AnalysisUsage &AU) const override {}
 };
+
+// The number given to the block by Namer, or ~0U if it has none.
+uint32_t getBlockId(const BasicBlock *);
 }
 
 #endif
@@ -44,7 +44,9 @@ struct Path {
     std::string Id;
     uint64_t Freq;
     PathType PType;
+    // Block names, or block numbers if read from a binary sequence file.
     std::vector<std::string> Seq;
+    std::vector<uint32_t> Ids;
     std::set<llvm::Value *> LiveIn, LiveOut, MemIn, MemOut, Globals;
 };
 
@@ -0,0 +1,137 @@
+#ifndef PATHID_H
+#define PATHID_H
+
+#include <llvm/ADT/APInt.h>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/ADT/StringRef.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+namespace epp {
+
+// Path ids, edge weights and increments are unsigned values modulo 2^Width,
+// where Width is the width of the path counter at runtime. PathIdTraits
+// provides the few operations the encoder and decoder need so that they can
+// be instantiated for native integer types. APInt is only used on hosts
+// which do not have a 128 bit integer type.
+template <typename T> struct PathIdTraits;
+
+template <typename T, unsigned W> struct NativePathIdTraits {
+    static const unsigned Width = W;
+
+    static T get(uint64_t V) { return V; }
+
+    static T neg(T V) { return T(0) - V; }
+
+    static bool ule(T A, T B) { return A <= B; }
+
+    // Returns true if the unsigned addition overflows.
+    static bool addOv(T A, T B, T &R) {
+        R = A + B;
+        return R < A;
+    }
+
+    static llvm::APInt toAPInt(T V) {
+        uint64_t Words[W / 64];
+        for (unsigned I = 0; I < W / 64; I++) {
+            Words[I] = static_cast<uint64_t>(V);
+            V        = (V >> 32) >> 32;
+        }
+        return llvm::APInt(W, llvm::makeArrayRef(Words));
+    }
+
+    // Parse a string in the given radix, e.g. a hex path id as written by
+    // the runtime. Returns false if the string is malformed or does not fit
+    // in W bits.
+    static bool fromString(llvm::StringRef S, T &R, unsigned Radix = 16) {
+        const T Max = ~T(0);
+        R           = 0;
+        for (auto C : S) {
+            auto D = llvm::hexDigitValue(C);
+            if (D >= Radix || R > (Max - D) / Radix)
+                return false;
+            R = R * Radix + D;
+        }
+        return !S.empty();
+    }
+
+    static std::string toString(T V, unsigned Radix = 10) {
+        std::string S;
+        do {
+            S.push_back("0123456789abcdef"[static_cast<unsigned>(V % Radix)]);
+            V /= Radix;
+        } while (V != 0);
+        std::reverse(S.begin(), S.end());
+        return S;
+    }
+};
+
+template <>
+struct PathIdTraits<uint64_t> : public NativePathIdTraits<uint64_t, 64> {};
+
+#ifdef __SIZEOF_INT128__
+
+template <>
+struct PathIdTraits<unsigned __int128>
+    : public NativePathIdTraits<unsigned __int128, 128> {};
+
+typedef unsigned __int128 WidePathIdTy;
+
+#else
+
+template <> struct PathIdTraits<llvm::APInt> {
+    static const unsigned Width = 128;
+
+    static llvm::APInt get(uint64_t V) { return llvm::APInt(Width, V); }
+
+    static llvm::APInt neg(const llvm::APInt &V) { return -V; }
+
+    static bool ule(const llvm::APInt &A, const llvm::APInt &B) {
+        return A.ule(B);
+    }
+
+    static bool addOv(const llvm::APInt &A, const llvm::APInt &B,
+                      llvm::APInt &R) {
+        bool Ov = false;
+        R       = A.uadd_ov(B, Ov);
+        return Ov;
+    }
+
+    static llvm::APInt toAPInt(const llvm::APInt &V) { return V; }
+
+    static bool fromString(llvm::StringRef S, llvm::APInt &R,
+                           unsigned Radix = 16) {
+        if (S.empty())
+            return false;
+        for (auto C : S)
+            if (llvm::hexDigitValue(C) >= Radix)
+                return false;
+        // Parse into twice the width so that overflow can be detected.
+        S = S.ltrim('0');
+        if (S.size() > (Radix == 16 ? Width / 4 : Width / 3))
+            return false;
+        if (S.empty()) {
+            R = get(0);
+            return true;
+        }
+        auto V = llvm::APInt(2 * Width, S, Radix);
+        if (V.getActiveBits() > Width)
+            return false;
+        R = V.trunc(Width);
+        return true;
+    }
+
+    static std::string toString(const llvm::APInt &V, unsigned Radix = 10) {
+        return V.toString(Radix, false);
+    }
+};
+
+typedef llvm::APInt WidePathIdTy;
+
+#endif
+}
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef PATHTRIE_H
+#define PATHTRIE_H
+
+#include "llvm/ADT/ArrayRef.h"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace common {
+
+// A set of paths over numbered blocks stored as a prefix tree. Decoded paths
+// start at the function entry, so most of them share long prefixes and each
+// block of a shared prefix is stored once. A path is identified by the node
+// of its last block, which holds its count. Node 0 is the root and stands
+// for the empty path, the parent of a node is always created before it.
+//
+// The children of a node are kept in a list since blocks have few
+// successors. Apart from the block number and the count, a node costs three
+// indices, instead of a vector and its allocation per path.
+class PathTrie {
+  public:
+    typedef uint32_t NodeId;
+    static const NodeId Root = 0;
+    static const NodeId None = ~0U;
+
+    PathTrie();
+
+    // The node of the path, which is added if it is not in the trie yet.
+    NodeId insert(llvm::ArrayRef<uint32_t> Path);
+
+    void add(NodeId N, uint64_t C);
+
+    uint64_t count(NodeId N) const { return Counts[N]; }
+
+    // Sum of the counts of all the paths which start with the path of N,
+    // including itself. The sums are computed again after a change with a
+    // single pass over the nodes, so this must not be called concurrently
+    // with a change.
+    uint64_t prefixCount(NodeId N) const;
+
+    NodeId parent(NodeId N) const { return Parents[N]; }
+
+    uint32_t block(NodeId N) const { return Blocks[N]; }
+
+    // The blocks of the path of N from the root.
+    std::vector<uint32_t> blocks(NodeId N) const;
+
+    // Calls F for each path with a non zero count in the order of the nodes.
+    void forEach(std::function<void(NodeId, uint64_t)> F) const;
+
+    // Score of a path from its node and its count.
+    typedef std::function<double(NodeId, uint64_t)> ScoreFn;
+
+    // The K paths with the highest scores in descending order, ties are
+    // broken by the order of the nodes. The score is the count by default.
+    std::vector<NodeId> top(size_t K, ScoreFn Score = nullptr) const;
+
+    size_t size() const { return Blocks.size(); }
+
+  private:
+    std::vector<uint32_t> Blocks;
+    std::vector<NodeId> Parents;
+    std::vector<NodeId> FirstChild;
+    std::vector<NodeId> NextSibling;
+    std::vector<uint64_t> Counts;
+
+    mutable std::vector<uint64_t> Totals;
+    mutable bool Dirty;
+
+    NodeId child(NodeId N, uint32_t B) const;
+};
+}
+
+#endif
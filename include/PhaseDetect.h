@@ -0,0 +1,23 @@
+#ifndef PHASEDETECT_H
+#define PHASEDETECT_H
+
+#include "llvm/ADT/StringRef.h"
+
+namespace epp {
+
+// Cluster the windows of a path trace (epp-trace-windows.txt, see -trace)
+// into phases in the same way as SimPoint. The path counts of each window
+// are normalized to frequencies and reduced to a few dimensions with a
+// random projection, then clustered with k-means for every number of phases
+// up to MaxPhases. As BIC scores can be negative, the smallest number of
+// phases whose score reaches 90% of the range between the lowest and the
+// highest score is kept.
+//
+// epp-phases.txt has a line per phase with its number, its number of
+// windows, its number of path executions and the window closest to its
+// centroid, followed by a line with the id:count pairs of its hottest
+// paths. epp-phase-windows.txt has the phase of each window, one per line.
+void detectPhases(llvm::StringRef WindowFile, unsigned MaxPhases);
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef REGIONCOST_H
+#define REGIONCOST_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/IR/BasicBlock.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace needle {
+
+// Resources a region (a path or a braid) takes once outlined, computed from
+// its blocks in the same way as NeedleOutliner before extracting it.
+struct RegionCost {
+    // Instructions of the region, a block shared by several paths of a
+    // braid is counted once.
+    uint64_t Ops;
+    // Values defined outside the region and used inside it, which are
+    // passed to the offloaded function. Globals are not counted.
+    uint64_t LiveIn;
+    // Values defined in the region and used after it, which are returned
+    // from the offloaded function.
+    uint64_t LiveOut;
+    // Stores of the region, each of which needs an entry in the undo log.
+    uint64_t UndoLog;
+    // Longest chain of dependent instructions along any path of the region,
+    // the latency of the region if it runs as a dataflow graph.
+    uint64_t CriticalPath;
+};
+
+// The cost of the region made of Paths, which all start at the same block.
+RegionCost getRegionCost(llvm::ArrayRef<std::vector<llvm::BasicBlock *>> Paths);
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef SEQUENCES_H
+#define SEQUENCES_H
+
+#include "llvm/ADT/StringRef.h"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace common {
+
+// A decoded path as stored in a binary sequence file. It holds the same
+// fields as a line of epp-sequences.txt, but the blocks are the numbers
+// given to them by epp::Namer instead of their names.
+struct SequenceRecord {
+    std::string Id;
+    uint64_t Freq;
+    uint32_t Type;
+    uint64_t NumIns;
+    std::vector<uint32_t> Blocks;
+};
+
+// Binary sequence files start with a magic string followed by the records,
+// each of which is written as
+//
+// u32 length of id, id (decimal), u64 freq, u32 path type,
+// u64 instructions, u32 number of blocks, u32 block numbers
+//
+// in the byte order of the host.
+bool isSequenceFile(llvm::StringRef);
+
+class SequenceWriter {
+    std::ofstream Out;
+
+  public:
+    SequenceWriter(llvm::StringRef);
+    void write(const SequenceRecord &);
+};
+
+class SequenceReader {
+    std::ifstream In;
+
+  public:
+    SequenceReader(llvm::StringRef);
+    // Read the next record, returns false at the end of the file.
+    bool next(SequenceRecord &);
+};
+}
+
+#endif
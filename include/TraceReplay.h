@@ -0,0 +1,62 @@
+#ifndef TRACEREPLAY_H
+#define TRACEREPLAY_H
+
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/BasicBlock.h"
+
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <vector>
+
+namespace epp {
+
+// Replays the blocks of a path trace (see -trace) through a candidate
+// region, the path or braid of a seq file written by needle-select, as if it
+// had been outlined. The region is entered each time its first block
+// executes and succeeds when its last block is reached without leaving it.
+// It fails at the guard of the last block executed in the region when the
+// next edge is not an edge of one of its paths, even if both blocks are in
+// the region, or when the first block is executed again.
+//
+// epp-replay.txt has the number of entries, successes and failures, the
+// number of blocks executed by failed invocations, which are rolled back,
+// and then a line per guard and position along the region (0 for the first
+// block) with the number of failures there.
+class TraceReplay {
+    std::vector<llvm::BasicBlock *> Blocks;
+    // Edges between consecutive blocks of the paths of the region.
+    llvm::DenseSet<std::pair<unsigned, unsigned>> Edges;
+    unsigned Start, End;
+
+    // State between two blocks of the trace.
+    bool Inside;
+    unsigned Pos, Prev;
+
+    enum Kind { Enter, Succeed, Fail };
+    struct Event {
+        Kind K;
+        unsigned Guard, Pos;
+    };
+
+    uint64_t Entries, Successes;
+    std::map<std::pair<unsigned, unsigned>, uint64_t> Failures;
+
+    void step(unsigned Block, std::vector<Event> &Events);
+    void apply(const Event &E, uint64_t Times);
+
+  public:
+    // Blocks are the blocks of the function, indexed like the blocks of the
+    // paths given to run.
+    TraceReplay(llvm::StringRef SeqFile,
+                const std::vector<llvm::BasicBlock *> &Blocks);
+
+    // Replay a path executed Count times in a row.
+    void run(const std::vector<unsigned> &Path, uint64_t Count);
+
+    void write() const;
+};
+}
+
+#endif
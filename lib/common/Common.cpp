@@ -44,6 +44,8 @@
 #include "llvm/Transforms/IPO/PassManagerBuilder.h"
 #include "llvm/Transforms/Scalar.h"
 
+#include <thread>
+
 using namespace llvm;
 using namespace std;
 
@@ -305,6 +307,28 @@ bool checkIntrinsic(CallSite &CS) {
     return true;
 }
 
+// Check for features which cannot be accelerated,
+// a) Indirect Function Calls
+// b) Function calls to external libraries
+// c) Large memory intrinsics
+bool isAcceleratable(BasicBlock *BB) {
+    for (auto &I : *BB) {
+        CallSite CS(&I);
+        if (CS.isCall() || CS.isInvoke()) {
+            if (!CS.getCalledFunction()) {
+                DEBUG(errs() << "Found indirect call\n");
+                return false;
+            } else if (CS.getCalledFunction()->isDeclaration() &&
+                       checkIntrinsic(CS)) {
+                DEBUG(errs() << "Lib Call: "
+                             << CS.getCalledFunction()->getName() << "\n");
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
 bool isSelfLoop(const BasicBlock *BB) {
     for (auto S = succ_begin(BB), E = succ_end(BB); S != E; S++) {
         if (*S == BB) {
@@ -470,4 +494,29 @@ void printPathSrc(SetVector<llvm::BasicBlock *> &blocks, raw_ostream &out) {
         }
     }
 }
+
+// The number of threads to use, 0 means one per core.
+unsigned getNumThreads(unsigned NumThreads) {
+    if (NumThreads)
+        return NumThreads;
+    return max(1u, thread::hardware_concurrency());
+}
+
+// Call Fn on NumThreads contiguous slices [Begin, End) of [0, N) in
+// parallel. The calling thread processes the first slice.
+void parallelFor(size_t N, unsigned NumThreads,
+                 function<void(size_t, size_t)> Fn) {
+    NumThreads = min<size_t>(getNumThreads(NumThreads), N);
+    if (NumThreads <= 1) {
+        Fn(0, N);
+        return;
+    }
+    size_t Chunk = (N + NumThreads - 1) / NumThreads;
+    vector<thread> Threads;
+    for (size_t B = Chunk; B < N; B += Chunk)
+        Threads.emplace_back(Fn, B, min(N, B + Chunk));
+    Fn(0, Chunk);
+    for (auto &T : Threads)
+        T.join();
+}
 }
@@ -0,0 +1,91 @@
+#include "PathTrie.h"
+
+#include <algorithm>
+#include <cassert>
+
+using namespace llvm;
+using namespace common;
+using namespace std;
+
+const PathTrie::NodeId PathTrie::Root;
+const PathTrie::NodeId PathTrie::None;
+
+PathTrie::PathTrie()
+    : Blocks(1, ~0U), Parents(1, None), FirstChild(1, None),
+      NextSibling(1, None), Counts(1, 0), Dirty(true) {}
+
+PathTrie::NodeId PathTrie::child(NodeId N, uint32_t B) const {
+    for (auto C = FirstChild[N]; C != None; C = NextSibling[C])
+        if (Blocks[C] == B)
+            return C;
+    return None;
+}
+
+PathTrie::NodeId PathTrie::insert(ArrayRef<uint32_t> Path) {
+    NodeId N = Root;
+    for (auto B : Path) {
+        auto C = child(N, B);
+        if (C == None) {
+            C = Blocks.size();
+            assert(C != None && "Too many nodes");
+            Blocks.push_back(B);
+            Parents.push_back(N);
+            FirstChild.push_back(None);
+            NextSibling.push_back(FirstChild[N]);
+            Counts.push_back(0);
+            FirstChild[N] = C;
+            Dirty         = true;
+        }
+        N = C;
+    }
+    return N;
+}
+
+void PathTrie::add(NodeId N, uint64_t C) {
+    Counts[N] += C;
+    Dirty = true;
+}
+
+uint64_t PathTrie::prefixCount(NodeId N) const {
+    if (Dirty) {
+        // Children are created after their parent, so a reverse pass adds
+        // each subtree to its parent once it is complete.
+        Totals = Counts;
+        for (NodeId I = Totals.size() - 1; I != Root; I--)
+            Totals[Parents[I]] += Totals[I];
+        Dirty = false;
+    }
+    return Totals[N];
+}
+
+vector<uint32_t> PathTrie::blocks(NodeId N) const {
+    vector<uint32_t> Path;
+    for (; N != Root; N = Parents[N])
+        Path.push_back(Blocks[N]);
+    reverse(Path.begin(), Path.end());
+    return Path;
+}
+
+void PathTrie::forEach(function<void(NodeId, uint64_t)> F) const {
+    for (NodeId N = 0; N < Counts.size(); N++)
+        if (Counts[N])
+            F(N, Counts[N]);
+}
+
+vector<PathTrie::NodeId> PathTrie::top(size_t K, ScoreFn Score) const {
+    vector<pair<double, NodeId>> Nodes;
+    forEach([&Nodes, &Score](NodeId N, uint64_t C) {
+        Nodes.push_back({Score ? Score(N, C) : static_cast<double>(C), N});
+    });
+    K = min(K, Nodes.size());
+    partial_sort(Nodes.begin(), Nodes.begin() + K, Nodes.end(),
+                 [](const pair<double, NodeId> &A,
+                    const pair<double, NodeId> &B) {
+                     return A.first > B.first ||
+                            (A.first == B.first && A.second < B.second);
+                 });
+    vector<NodeId> Top;
+    for (size_t I = 0; I < K; I++)
+        Top.push_back(Nodes[I].second);
+    return Top;
+}
@@ -0,0 +1,67 @@
+#include "Sequences.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/ErrorHandling.h"
+
+#include <cassert>
+#include <cstring>
+
+using namespace llvm;
+using namespace common;
+using namespace std;
+
+static const char Magic[8] = {'N', 'D', 'L', 'S', 'E', 'Q', '0', '1'};
+
+template <typename T> static void put(ofstream &Out, T V) {
+    Out.write(reinterpret_cast<const char *>(&V), sizeof(T));
+}
+
+template <typename T> static bool get(ifstream &In, T &V) {
+    return static_cast<bool>(
+        In.read(reinterpret_cast<char *>(&V), sizeof(T)));
+}
+
+bool common::isSequenceFile(StringRef Filename) {
+    ifstream In(Filename.str(), ios::in | ios::binary);
+    char Buf[sizeof(Magic)];
+    return In.read(Buf, sizeof(Buf)) && !memcmp(Buf, Magic, sizeof(Magic));
+}
+
+SequenceWriter::SequenceWriter(StringRef Filename)
+    : Out(Filename.str(), ios::out | ios::binary) {
+    assert(Out.is_open() && "Could not open file for writing");
+    Out.write(Magic, sizeof(Magic));
+}
+
+void SequenceWriter::write(const SequenceRecord &R) {
+    put<uint32_t>(Out, R.Id.size());
+    Out.write(R.Id.data(), R.Id.size());
+    put<uint64_t>(Out, R.Freq);
+    put<uint32_t>(Out, R.Type);
+    put<uint64_t>(Out, R.NumIns);
+    put<uint32_t>(Out, R.Blocks.size());
+    Out.write(reinterpret_cast<const char *>(R.Blocks.data()),
+              R.Blocks.size() * sizeof(uint32_t));
+}
+
+SequenceReader::SequenceReader(StringRef Filename)
+    : In(Filename.str(), ios::in | ios::binary) {
+    char Buf[sizeof(Magic)];
+    if (!In.read(Buf, sizeof(Buf)) || memcmp(Buf, Magic, sizeof(Magic)))
+        report_fatal_error(Twine("Not a sequence file : ") + Filename);
+}
+
+bool SequenceReader::next(SequenceRecord &R) {
+    uint32_t Len;
+    if (!get(In, Len))
+        return false;
+    R.Id.resize(Len);
+    uint32_t NumBlocks;
+    if (!In.read(&R.Id[0], Len) || !get(In, R.Freq) || !get(In, R.Type) ||
+        !get(In, R.NumIns) || !get(In, NumBlocks))
+        report_fatal_error("Truncated sequence file");
+    R.Blocks.resize(NumBlocks);
+    if (!In.read(reinterpret_cast<char *>(R.Blocks.data()),
+                 NumBlocks * sizeof(uint32_t)))
+        report_fatal_error("Truncated sequence file");
+    return true;
+}
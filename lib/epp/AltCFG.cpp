@@ -1,71 +1,112 @@
 #define DEBUG_TYPE "epp_encode"
 #include "AltCFG.h"
+#include "llvm/ADT/DenseMap.h"
 
-namespace epp {
+#include <vector>
 
-inline void altcfg::initWt(Edge E, APInt Val = APInt(128, 0, true)) {
-    Weights[E] = Val;
-}
+namespace epp {
 
-static APInt dir(const Edge &E, const Edge &F) {
+// Returns true if Dir(E, F) is +1 and false if it is -1.
+static bool dir(const Edge &E, const Edge &F) {
     if (SRC(E) == nullptr && TGT(E) == nullptr)
-        return APInt(128, 1, true);
+        return true;
     else if (SRC(E) == TGT(F) || TGT(E) == SRC(F))
-        return APInt(128, 1, true);
+        return true;
     else
-        return APInt(128, -1, true);
+        return false;
 }
 
-static void incDFSHelper(APInt Events, BasicBlock *V, Edge E,
-                         const EdgeListTy &ST, const EdgeListTy &Chords,
-                         EdgeWtMapTy &Val, EdgeWtMapTy &Inc) {
-    //  for each f belongs to T : f != e and v = tgt( f ) do
-    //      DFS( Dir(e, f ) * events + Events( f ) , src( f ) , f )
-    //  od
-    //  for each f belongs to T : f != e and v = src( f ) do
-    //      DFS( Dir(e, f ) * events + Events( f ) , tgt( f ) , f )
-    //  od
-    //  for each f belongs to E − T : v = src( f ) or v = tgt( f ) do
-    //      Increment( f ) : = Increment( f ) + Dir(e, f ) * events
-    //  fi
-
-    for (auto &F : ST) {
-        if (E != F && V == TGT(F))
-            incDFSHelper(dir(E, F) * Events + Val[F], SRC(F), F, ST, Chords,
-                         Val, Inc);
-    }
+// Compute the increments for the chords as described in Ball & Larus,
+// Efficient Path Profiling, Figure 4. The spanning tree is traversed as an
+// undirected graph with an explicit stack, and the tree edges and chords
+// incident on each block are indexed upfront, so each vertex and edge is
+// visited once. The recursive formulation from the paper is
+//
+//  DFS( events, v, e )
+//  for each f belongs to T : f != e and v = tgt( f ) do
+//      DFS( Dir(e, f ) * events + Events( f ) , src( f ) , f )
+//  od
+//  for each f belongs to T : f != e and v = src( f ) do
+//      DFS( Dir(e, f ) * events + Events( f ) , tgt( f ) , f )
+//  od
+//  for each f belongs to E - T : v = src( f ) or v = tgt( f ) do
+//      Increment( f ) : = Increment( f ) + Dir(e, f ) * events
+//  od
+template <typename PathIdTy>
+void altcfg<PathIdTy>::computeIncrement(EdgeWtMapTy<PathIdTy> &Inc,
+                                        BasicBlock *Entry, BasicBlock *Exit,
+                                        EdgeListTy &Chords, EdgeListTy &ST) {
+
+    Chords.insert({Exit, Entry});
 
-    for (auto &F : ST) {
-        if (E != F && V == SRC(F))
-            incDFSHelper(dir(E, F) * Events + Val[F], TGT(F), F, ST, Chords,
-                         Val, Inc);
+    DenseMap<const BasicBlock *, uint32_t> Index;
+    for (auto &KV : CFG)
+        Index.insert({KV.first, Index.size()});
+    // A function with a single block has no edges in the CFG.
+    Index.insert({Entry, Index.size()});
+    Index.insert({Exit, Index.size()});
+
+    const uint32_t None = ~0U;
+    typedef SmallVector<uint32_t, 4> IncidentTy;
+    vector<IncidentTy> TreeAdj(Index.size()), ChordAdj(Index.size());
+    vector<pair<uint32_t, uint32_t>> TreeEnds;
+
+    for (uint32_t I = 0; I < ST.size(); I++) {
+        auto S = Index.lookup(SRC(ST[I])), T = Index.lookup(TGT(ST[I]));
+        TreeEnds.push_back({S, T});
+        TreeAdj[S].push_back(I);
+        TreeAdj[T].push_back(I);
     }
 
-    for (auto &C : Chords) {
-        if (V == SRC(C) || V == TGT(C))
-            Inc[C] = Inc[C] + dir(E, C) * Events;
+    for (uint32_t I = 0; I < Chords.size(); I++) {
+        auto S = Index.lookup(SRC(Chords[I])),
+             T = Index.lookup(TGT(Chords[I]));
+        ChordAdj[S].push_back(I);
+        if (S != T)
+            ChordAdj[T].push_back(I);
     }
-}
 
-void altcfg::computeIncrement(EdgeWtMapTy &Inc, BasicBlock *Entry,
-                              BasicBlock *Exit, EdgeListTy &Chords,
-                              EdgeListTy &ST) {
+    struct Frame {
+        uint32_t V;
+        uint32_t Via;
+        PathIdTy Events;
+    };
 
-    Chords.insert({Exit, Entry});
-    for (auto &C : Chords)
-        Inc.insert({C, APInt(128, 0, true)});
+    // Dir(E, F) * Events
+    auto scale = [](const Edge &E, const Edge &F, const PathIdTy &Events) {
+        return dir(E, F) ? Events : Traits::neg(Events);
+    };
 
-    incDFSHelper(APInt(128, 0, true), Entry, {nullptr, nullptr}, ST, Chords,
-                 Weights, Inc);
+    vector<PathIdTy> ChordInc(Chords.size(), Traits::get(0));
+    SmallVector<Frame, 32> Stack;
+    Stack.push_back({Index.lookup(Entry), None, Traits::get(0)});
+
+    while (!Stack.empty()) {
+        auto Top = Stack.pop_back_val();
+        Edge E   = Top.Via == None ? Edge(nullptr, nullptr) : ST[Top.Via];
+
+        for (auto I : TreeAdj[Top.V]) {
+            if (I == Top.Via)
+                continue;
+            auto &F   = ST[I];
+            auto Next = TreeEnds[I].first == Top.V ? TreeEnds[I].second
+                                                   : TreeEnds[I].first;
+            Stack.push_back({Next, I, scale(E, F, Top.Events) + Weights[F]});
+        }
+
+        for (auto I : ChordAdj[Top.V])
+            ChordInc[I] = ChordInc[I] + scale(E, Chords[I], Top.Events);
+    }
 
     initWt({Exit, Entry});
 
-    for (auto &C : Chords) {
-        Inc[C] = Inc[C] + Weights[C];
+    for (uint32_t I = 0; I < Chords.size(); I++) {
+        Inc.insert({Chords[I], ChordInc[I] + Weights[Chords[I]]});
     }
 }
 
-EdgeListTy altcfg::getChords(EdgeListTy &ST) const {
+template <typename PathIdTy>
+EdgeListTy altcfg<PathIdTy>::getChords(EdgeListTy &ST) const {
     DenseSet<Edge> SpanningEdges;
     for (auto &E : ST)
         SpanningEdges.insert(E);
@@ -79,115 +120,124 @@ EdgeListTy altcfg::getChords(EdgeListTy &ST) const {
     return Chords;
 }
 
-EdgeWtMapTy altcfg::getIncrements(BasicBlock *Entry, BasicBlock *Exit) {
-    EdgeWtMapTy Inc;
+template <typename PathIdTy>
+EdgeWtMapTy<PathIdTy> altcfg<PathIdTy>::getIncrements(BasicBlock *Entry,
+                                                      BasicBlock *Exit) {
+    EdgeWtMapTy<PathIdTy> Inc;
     auto ST = getSpanningTree(Entry);
     auto C  = getChords(ST);
     computeIncrement(Inc, Entry, Exit, C, ST);
     return Inc;
 }
 
-void altcfg::spanningHelper(BasicBlock *ToVisit, EdgeListTy &ST,
-                            DenseSet<BasicBlock *> &Seen) {
-    Seen.insert(ToVisit);
-    for (auto S : succs(ToVisit)) {
-        if (!Seen.count(S)) {
-            ST.insert({ToVisit, S});
-            spanningHelper(S, ST, Seen);
+// Depth first traversal of the alternate CFG from Entry, the first edge
+// which reaches a block is added to the spanning tree.
+template <typename PathIdTy>
+EdgeListTy altcfg<PathIdTy>::getSpanningTree(BasicBlock *Entry) {
+    EdgeListTy SpanningTree;
+    DenseSet<BasicBlock *> Seen;
+    SmallVector<pair<BasicBlock *, uint32_t>, 32> Stack;
+
+    Seen.insert(Entry);
+    Stack.push_back({Entry, 0});
+    while (!Stack.empty()) {
+        auto *V     = Stack.back().first;
+        auto &Succs = succs(V);
+        if (Stack.back().second == Succs.size()) {
+            Stack.pop_back();
+            continue;
+        }
+        auto *S = Succs[Stack.back().second++];
+        if (Seen.insert(S).second) {
+            SpanningTree.insert({V, S});
+            Stack.push_back({S, 0});
         }
     }
-}
 
-EdgeListTy altcfg::getSpanningTree(BasicBlock *Entry) {
-    EdgeListTy SpanningTree;
-    DenseSet<BasicBlock *> Seen;
-    spanningHelper(Entry, SpanningTree, Seen);
     assert(Seen.size() == CFG.size() && "SpanningTree missing some nodes!");
     return SpanningTree;
 }
 
-APInt &altcfg::operator[](const Edge &E) { return Weights[E]; }
+template <typename PathIdTy>
+PathIdTy &altcfg<PathIdTy>::operator[](const Edge &E) {
+    return Weights[E];
+}
 
-EdgeListTy altcfg::get() const {
-    EdgeListTy Ret;
-    for (auto &E : Edges) {
-        if (SegmentMap.count(E)) {
-            Ret.insert(SegmentMap.lookup(E).first);
-            Ret.insert(SegmentMap.lookup(E).second);
-        } else {
-            Ret.insert(E);
-        }
+template <typename PathIdTy>
+void altcfg<PathIdTy>::insertEdge(const Edge &E) {
+    // Register both blocks before touching the adjacency lists, inserting
+    // into the MapVector can move the existing entries around.
+    CFG[SRC(E)];
+    CFG[TGT(E)];
+    initWt(E);
+    if (Edges.insert(E)) {
+        CFG[SRC(E)].Succs.push_back(TGT(E));
+        CFG[TGT(E)].Preds.push_back(SRC(E));
     }
-    return Ret;
+    DEBUG(errs() << "Added to CFG : " << SRC(E)->getName() << " "
+                 << TGT(E)->getName() << "\n");
 }
 
-bool altcfg::add(BasicBlock *Src, BasicBlock *Tgt, BasicBlock *Entry,
-                 BasicBlock *Exit) {
-
-    assert(((Entry == nullptr && Exit == nullptr) ||
-            (Entry != nullptr && Exit != nullptr)) &&
-           "Both Entry and Exit must be defined or neither");
-
-    auto initSuccList = [this](BasicBlock *Src) {
-        if (CFG.count(Src) == 0) {
-            CFG.insert({Src, SuccListTy()});
-        }
-    };
-
-    auto insertCFG = [this, &initSuccList](BasicBlock *Src, BasicBlock *Tgt) {
-        initSuccList(Src);
-        initSuccList(Tgt);
-        CFG[Src].insert(Tgt);
-        initWt({Src, Tgt});
-        DEBUG(errs() << "Added to CFG : " << Src->getName() << " "
-                     << Tgt->getName() << "\n");
-    };
-
-    insertCFG(Src, Tgt);
-    SuccCache.erase(Src);
-    Edges.insert({Src, Tgt});
-
+// Add the edge (Src, Tgt), if Entry and Exit are given the edge is segmented
+// into the fake edges (Src, Exit) and (Entry, Tgt). If only one of them is
+// given only that half is added, this is used for edges entering (Exit) or
+// leaving (Entry) a collapsed region. The missing half is recorded in the
+// SegmentMap as a null edge.
+template <typename PathIdTy>
+bool altcfg<PathIdTy>::add(BasicBlock *Src, BasicBlock *Tgt, BasicBlock *Entry,
+                           BasicBlock *Exit) {
     // This is an edge which needs to segmented
-    if (Entry && Exit) {
+    if (Entry || Exit) {
         DEBUG(errs() << "Adding Fakes\n");
-        SegmentMap[{Src, Tgt}] = {{Src, Exit}, {Entry, Tgt}};
-        insertCFG(Src, Exit);
-        insertCFG(Entry, Tgt);
-        SuccCache.erase(Entry);
+        Edge Out = {nullptr, nullptr}, In = {nullptr, nullptr};
+        if (Exit) {
+            Out = {Src, Exit};
+            insertEdge(Out);
+            FakeEdges.insert(Out);
+        }
+        if (Entry) {
+            In = {Entry, Tgt};
+            insertEdge(In);
+            FakeEdges.insert(In);
+        }
+        SegmentMap[{Src, Tgt}] = {Out, In};
+    } else {
+        insertEdge({Src, Tgt});
     }
     return true;
 }
 
-SmallVector<BasicBlock *, 4> altcfg::succs(const BasicBlock *B) {
+template <typename PathIdTy>
+const AdjListTy &altcfg<PathIdTy>::succs(const BasicBlock *B) const {
     assert(CFG.count(B) && "Block does not exist in CFG");
-    if (SuccCache.count(B) == 0) {
-        SmallVector<BasicBlock *, 4> R;
-        for (auto &E : get()) {
-            if (SRC(E) == B)
-                R.push_back(TGT(E));
-        }
-        SuccCache.insert({B, R});
-        return R;
-    } else {
-        return SuccCache.lookup(B);
-    }
+    return CFG.find(B)->second.Succs;
+}
+
+template <typename PathIdTy>
+const AdjListTy &altcfg<PathIdTy>::preds(const BasicBlock *B) const {
+    assert(CFG.count(B) && "Block does not exist in CFG");
+    return CFG.find(B)->second.Preds;
 }
 
-void altcfg::print(raw_ostream &os) const {
+template <typename PathIdTy>
+void altcfg<PathIdTy>::print(raw_ostream &os) const {
     os << "Alternate CFG for EPP\n";
     uint64_t Ctr = 0;
     for (auto &E : get()) {
         os << Ctr++ << " " << SRC(E)->getName() << "->" << TGT(E)->getName()
-           << " " << Weights.find(E)->second << "\n";
+           << " " << Traits::toString(Weights.find(E)->second) << "\n";
     }
 }
 
-void altcfg::dot(raw_ostream &os) const {
+template <typename PathIdTy>
+void altcfg<PathIdTy>::dot(raw_ostream &os) const {
     os << "digraph \"AltCFG\" {\n label=\"AltCFG\";\n";
     DenseSet<BasicBlock *> Nodes;
     for (auto &E : get()) {
         os << "\tNode" << SRC(E) << " -> Node" << TGT(E) << " [style=solid,"
-           << " label=\"" << Weights.find({SRC(E), TGT(E)})->second << "\"];\n";
+           << " label=\""
+           << Traits::toString(Weights.find({SRC(E), TGT(E)})->second)
+           << "\"];\n";
         Nodes.insert(SRC(E));
         Nodes.insert(TGT(E));
     }
@@ -198,13 +248,6 @@ void altcfg::dot(raw_ostream &os) const {
     os << "}\n";
 }
 
-EdgeListTy altcfg::getFakeEdges() const {
-    EdgeListTy F;
-    for (auto &KV : SegmentMap) {
-        auto Fakes = KV.second;
-        F.insert(Fakes.first);
-        F.insert(Fakes.second);
-    }
-    return F;
-}
+template class altcfg<uint64_t>;
+template class altcfg<WidePathIdTy>;
 }
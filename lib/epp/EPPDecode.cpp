@@ -1,18 +1,34 @@
 #define DEBUG_TYPE "epp_decode"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/CallSite.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DebugInfo.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MathExtras.h"
 #include "llvm/Support/raw_ostream.h"
 #include <fstream>
 
+#include <algorithm>
+#include <functional>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <queue>
 #include <unordered_map>
 
 #include "Common.h"
 #include "EPPDecode.h"
+#include "Namer.h"
+#include "PathTrie.h"
+#include "PhaseDetect.h"
+#include "Sequences.h"
+#include "TraceReplay.h"
 
 using namespace llvm;
 using namespace epp;
@@ -22,198 +38,867 @@ extern cl::list<string> FunctionList;
 extern bool isTargetFunction(const Function &, const cl::list<string> &);
 extern cl::opt<string> profile;
 extern cl::opt<bool> printSrcLines;
-
-void printPath(vector<llvm::BasicBlock *> &Blocks, ofstream &Outfile) {
+extern cl::opt<unsigned> numThreads;
+extern cl::opt<unsigned> numTop;
+extern cl::opt<bool> binarySeq;
+extern cl::opt<bool> traceProfile;
+extern cl::opt<unsigned> traceWindow;
+extern cl::opt<unsigned> numPhases;
+extern cl::opt<unsigned> decodeMemory;
+extern cl::opt<string> replayRegion;
+
+void epp::printPath(vector<llvm::BasicBlock *> &Blocks, ofstream &Outfile) {
     for (auto *BB : Blocks) {
         DEBUG(errs() << BB->getName() << " ");
         Outfile << BB->getName().str() << " ";
     }
 }
 
-struct Path {
+// The blocks of a path are stored in a PathTrie, node is the path of block
+// numbers of the DecodeTable.
+template <typename PathIdTy> struct Path {
     Function *Func;
-    APInt id;
+    PathIdTy id;
     uint64_t count;
-    pair<PathType, vector<BasicBlock *>> blocks;
+    PathType type;
+    common::PathTrie::NodeId node;
+    uint64_t numIns;
 };
 
-static bool isFunctionExiting(BasicBlock *BB) {
-    if (BB->getTerminator()->getNumSuccessors() == 0)
-        return true;
-    return false;
+// Number of paths decoded in parallel before they are added to the trie.
+static const size_t BatchSize = 1 << 16;
+
+// Largest number of sorted runs merged at once with -decode-mem.
+static const size_t MaxFanIn = 64;
+
+BlockSummary epp::summarizeBlock(BasicBlock *BB) {
+    BlockSummary S = {common::isAcceleratable(BB), 0, 0};
+    for (auto &I : *BB) {
+        S.NumIns++;
+        if (isa<PHINode>(&I) || isa<DbgInfoIntrinsic>(&I))
+            continue;
+        if (auto *BI = dyn_cast<BranchInst>(&I))
+            if (BI->isUnconditional())
+                continue;
+        S.Cost++;
+    }
+    return S;
 }
 
-static uint64_t pathCheck(vector<BasicBlock *> &Blocks) {
-    // Check for un-acceleratable paths,
-    // a) Indirect Function Calls
-    // b) Function calls to external libraries
-    // c) Memory allocations
+uint64_t epp::pathCheck(vector<BasicBlock *> &Blocks) {
+    // Check for un-acceleratable paths, see common::isAcceleratable
     // return 0 if un-acceleratable or num_ins otherwise
 
     uint64_t NumIns = 0;
     for (auto BB : Blocks) {
-        for (auto &I : *BB) {
-            CallSite CS(&I);
-            if (CS.isCall() || CS.isInvoke()) {
-                if (!CS.getCalledFunction()) {
-                    errs() << "Found indirect call\n";
-                    return 0;
-                } else {
-                    if (CS.getCalledFunction()->isDeclaration() &&
-                        common::checkIntrinsic(CS)) {
-                        DEBUG(errs() << "Lib Call: "
-                                     << CS.getCalledFunction()->getName()
-                                     << "\n");
-                        return 0;
-                    }
-                }
-            }
-        }
-        uint64_t N = BB->getInstList().size();
-        NumIns += N;
+        auto S = summarizeBlock(BB);
+        if (!S.Acceleratable)
+            return 0;
+        NumIns += S.NumIns;
     }
 
     return NumIns;
 }
 
-bool EPPDecode::runOnModule(Module &M) {
-    ifstream inFile(profile.c_str(), ios::in);
-    assert(inFile.is_open() && "Could not open file for reading");
+template <typename PathIdTy>
+static bool readPath(istream &inFile, PathIdTy &PathId, uint64_t &PathCount) {
+    string PathIdStr;
+    if (!(inFile >> PathIdStr >> PathCount))
+        return false;
+    if (!PathIdTraits<PathIdTy>::fromString(PathIdStr, PathId))
+        report_fatal_error("Invalid path id in profile");
+    return true;
+}
 
-    uint64_t totalPathCount;
-    inFile >> totalPathCount;
+// Weight of the heaviest path of the alternate CFG, which is an upper bound
+// of the weight of any decoded path.
+template <typename PathIdTy>
+static uint64_t longestPath(const DecodeTable<PathIdTy> &T,
+                            function<uint64_t(unsigned)> Weight) {
+    enum { New, Open, Done };
+    vector<uint64_t> Longest(T.Blocks.size(), 0);
+    vector<char> State(T.Blocks.size(), New);
+    vector<unsigned> Stack = {T.Entry};
+    // Depth first search, a block is finished once all its successors are.
+    while (!Stack.empty()) {
+        auto B = Stack.back();
+        if (State[B] == New) {
+            State[B] = Open;
+            for (auto I = T.Begin[B]; I < T.Begin[B + 1]; I++)
+                if (State[T.Succs[I]] == New)
+                    Stack.push_back(T.Succs[I]);
+            continue;
+        }
+        Stack.pop_back();
+        if (State[B] == Done)
+            continue;
+        uint64_t Max = 0;
+        for (auto I = T.Begin[B]; I < T.Begin[B + 1]; I++)
+            Max = max(Max, Longest[T.Succs[I]]);
+        Longest[B] = Max + Weight(B);
+        State[B]   = Done;
+    }
+    return Longest[T.Entry];
+}
 
-    vector<Path> paths;
-    paths.reserve(totalPathCount);
+// Number of instructions on the longest path of the alternate CFG.
+template <typename PathIdTy>
+static uint64_t maxInstructions(const DecodeTable<PathIdTy> &T) {
+    return longestPath(T, [&T](unsigned B) { return T.Blocks[B]->size(); });
+}
 
-    EPPEncode *Enc = nullptr;
-    for (auto &F : M) {
-        if (isTargetFunction(F, FunctionList)) {
-            Enc = &getAnalysis<EPPEncode>(F);
-            vector<uint64_t> counts(totalPathCount, 0);
-            string PathIdStr;
-            uint64_t PathCount;
-            while (inFile >> PathIdStr >> PathCount) {
-                APInt PathId(128, StringRef(PathIdStr), 16);
-                paths.push_back({&F, PathId, PathCount});
-            }
+// Number of blocks on the longest path of the alternate CFG.
+template <typename PathIdTy>
+static uint64_t maxBlocks(const DecodeTable<PathIdTy> &T) {
+    return longestPath(T, [](unsigned) { return 1; });
+}
+
+// Executed instructions of a path, its count times its size.
+template <typename PathIdTy>
+static double coverage(const Path<PathIdTy> &P) {
+    return static_cast<double>(P.count) * P.numIns;
+}
+
+// Order of the paths selected with -top, descending order of coverage. Ties
+// are broken by descending id as when sorting by count.
+template <typename PathIdTy>
+static bool byCoverage(const Path<PathIdTy> &P1, const Path<PathIdTy> &P2) {
+    typedef PathIdTraits<PathIdTy> Traits;
+    return coverage(P1) > coverage(P2) ||
+           (coverage(P1) == coverage(P2) && Traits::ule(P2.id, P1.id));
+}
+
+// The K paths with the highest coverage, i.e count times the number of
+// instructions, in descending order. The profile is streamed through a
+// heap of the best K paths so far, and a path is only decoded if its count
+// times the size of the longest path can beat the worst of them. Time and
+// memory depend on K instead of the number of paths in the profile. The
+// blocks of the K paths are added to the trie at the end.
+template <typename PathIdTy>
+static vector<Path<PathIdTy>> topPaths(Function &F,
+                                       const DecodeTable<PathIdTy> &Table,
+                                       common::PathTrie &Trie, istream &inFile,
+                                       size_t K) {
+    typedef pair<Path<PathIdTy>, vector<unsigned>> Candidate;
+
+    auto Better = [](const Candidate &C1, const Candidate &C2) {
+        return byCoverage(C1.first, C2.first);
+    };
+    // The worst path is at the top.
+    priority_queue<Candidate, vector<Candidate>, decltype(Better)> Heap(
+        Better);
+
+    const double Bound = maxInstructions(Table);
+    uint64_t Decoded = 0, Skipped = 0;
+
+    PathIdTy PathId;
+    uint64_t PathCount;
+    while (readPath(inFile, PathId, PathCount)) {
+        if (Heap.size() == K &&
+            PathCount * Bound < coverage(Heap.top().first)) {
+            Skipped++;
+            continue;
         }
+        Path<PathIdTy> P = {&F, PathId, PathCount};
+        auto Blocks      = EPPDecode::decode(PathId, Table);
+        P.type           = Blocks.first;
+        P.numIns         = Table.pathCheck(trimPath(Blocks));
+        Decoded++;
+        if (!P.numIns)
+            continue;
+        Heap.push({P, move(Blocks.second)});
+        if (Heap.size() > K)
+            Heap.pop();
     }
-    inFile.close();
+    DEBUG(errs() << "Decoded " << Decoded << " Skipped " << Skipped << "\n");
+
+    vector<Path<PathIdTy>> Top;
+    for (; !Heap.empty(); Heap.pop()) {
+        auto &C = Heap.top();
+        auto P  = C.first;
+        P.node  = Trie.insert(C.second);
+        Trie.add(P.node, P.count);
+        Top.push_back(P);
+    }
+    reverse(Top.begin(), Top.end());
+    return Top;
+}
 
-    // vector<pair<PathType, vector<llvm::BasicBlock *>>>
-    // bbSequences;
-    // bbSequences.reserve(totalPathCount);
-    // for (auto &path : paths) {
-    // bbSequences.push_back(decode(*path.Func, path.id, *Enc));
-    //}
+// Order of the paths in the output, descending order of their frequency.
+// If the frequency is same, descending order of id (id cannot be same)
+template <typename PathIdTy>
+static bool byCount(const Path<PathIdTy> &P1, const Path<PathIdTy> &P2) {
+    typedef PathIdTraits<PathIdTy> Traits;
+    return (P1.count > P2.count) ||
+           (P1.count == P2.count && Traits::ule(P2.id, P1.id));
+}
 
-    for (auto &path : paths) {
-        path.blocks = decode(*path.Func, path.id, *Enc);
+template <typename PathIdTy>
+static void sortByCount(vector<Path<PathIdTy>> &paths) {
+    common::parallelSort(paths.begin(), paths.end(), numThreads,
+                         byCount<PathIdTy>);
+}
+
+// The K paths with the highest coverage when the trie already holds all of
+// them, as with -trace. The trie ranks its nodes by their count times the
+// instructions of their paths. Paths whose blocks are the same but whose
+// types differ share a node, so the paths of the best K nodes are ranked
+// again and cut to K.
+template <typename PathIdTy>
+static vector<Path<PathIdTy>> hotPaths(const common::PathTrie &Trie,
+                                       const vector<Path<PathIdTy>> &paths,
+                                       size_t K) {
+    vector<uint64_t> NumIns(Trie.size(), 0);
+    for (auto &path : paths)
+        NumIns[path.node] = max(NumIns[path.node], path.numIns);
+    vector<bool> Hot(Trie.size(), false);
+    for (auto N : Trie.top(K, [&NumIns](common::PathTrie::NodeId N,
+                                        uint64_t C) {
+             return static_cast<double>(C) * NumIns[N];
+         }))
+        Hot[N] = true;
+
+    vector<Path<PathIdTy>> Top;
+    for (auto &path : paths)
+        if (Hot[path.node] && path.numIns)
+            Top.push_back(path);
+    sort(Top.begin(), Top.end(), byCoverage<PathIdTy>);
+    if (Top.size() > K)
+        Top.resize(K);
+    return Top;
+}
+
+// Destination of the decoded paths, epp-sequences.txt or epp-sequences.bin
+// with -seq-binary. The blocks of the records given to write are numbers of
+// the table, the binary format refers to the blocks by their Namer numbers.
+template <typename PathIdTy> class SequenceOutput {
+    const DecodeTable<PathIdTy> &Table;
+    ofstream Outfile;
+    unique_ptr<common::SequenceWriter> Writer;
+
+  public:
+    SequenceOutput(const DecodeTable<PathIdTy> &T) : Table(T) {
+        if (binarySeq)
+            Writer.reset(new common::SequenceWriter("epp-sequences.bin"));
+        else
+            Outfile.open("epp-sequences.txt", ios::out);
     }
 
-    // Sort the paths in descending order of their frequency
-    // If the frequency is same, descending order of id (id cannot be same)
-    sort(paths.begin(), paths.end(), [](const Path &P1, const Path &P2) {
-        return (P1.count > P2.count) ||
-               (P1.count == P2.count && P1.id.uge(P2.id));
-    });
+    void write(common::SequenceRecord R) {
+        if (Writer) {
+            for (auto &B : R.Blocks) {
+                assert(Table.Ids[B] != ~0U && "Block is not numbered");
+                B = Table.Ids[B];
+            }
+            Writer->write(R);
+        } else {
+            vector<BasicBlock *> blocks;
+            for (auto B : R.Blocks)
+                blocks.push_back(Table.Blocks[B]);
+            Outfile << R.Id << " " << R.Freq << " ";
+            Outfile << R.Type << " ";
+            Outfile << R.NumIns << " ";
+            printPath(blocks, Outfile);
+            Outfile << "\n";
+        }
+    }
+};
 
-    ofstream Outfile("epp-sequences.txt", ios::out);
+// Write the paths in order, paths which cannot be accelerated are left out.
+template <typename PathIdTy>
+static void writePaths(const DecodeTable<PathIdTy> &Table,
+                       const common::PathTrie &Trie,
+                       const vector<Path<PathIdTy>> &paths) {
+    typedef PathIdTraits<PathIdTy> Traits;
 
+    SequenceOutput<PathIdTy> Out(Table);
     uint64_t pathFail = 0;
     // Dump paths
-    // for (size_t i = 0, e = bbSequences.size(); i < e; ++i) {
     for (auto &path : paths) {
-        auto pType = path.blocks.first;
-        int start = 0, end = 0;
-        switch (pType) {
-        case RIRO:
-            break;
-        case FIRO:
-            start = 1;
-            break;
-        case RIFO:
-            end = 1;
-            break;
-        case FIFO:
-            start = 1;
-            end   = 1;
-            break;
-        }
-        vector<BasicBlock *> blocks(path.blocks.second.begin() + start,
-                                    path.blocks.second.end() - end);
+        auto pType   = path.type;
+        auto Trimmed = trimPath(make_pair(pType, Trie.blocks(path.node)));
 
-        if (auto Count = pathCheck(blocks)) {
+        if (auto Count = path.numIns) {
             DEBUG(errs() << path.count << " ");
-            Outfile << path.id.toString(10, false) << " " << path.count << " ";
-            Outfile << static_cast<int>(pType) << " ";
-            Outfile << Count << " ";
-            printPath(blocks, Outfile);
-            Outfile << "\n";
+            Out.write({Traits::toString(path.id), path.count,
+                       static_cast<uint32_t>(pType), Count, Trimmed});
         } else {
             pathFail++;
             DEBUG(errs() << "Path Fail\n");
         }
-        DEBUG(errs() << "Path ID: " << path.id.toString(10, false)
+        DEBUG(errs() << "Path ID: " << Traits::toString(path.id)
                      << " Freq: " << path.count << "\n");
 
         if (printSrcLines) {
-            // TODO : Cleanup -- change the declaration on line 155 to SetVector
-            SetVector<BasicBlock *> SetBlocks(blocks.begin(), blocks.end());
+            SetVector<BasicBlock *> SetBlocks;
+            for (auto B : Trimmed)
+                SetBlocks.insert(Table.Blocks[B]);
             common::printPathSrc(SetBlocks);
         }
         DEBUG(errs() << "\n");
     }
 
     DEBUG(errs() << "Path Check Fails : " << pathFail << "\n");
+}
+
+// Number of times each block of the table was executed, from the counts of
+// the paths. Every path through a node of the trie executes its block, so
+// each node adds the counts of the paths with its prefix. The endpoints of
+// fake edges are then taken off, so that the block where a path ends and
+// the next one starts is only counted once. Paths start at the entry and
+// the last block of a path is its node.
+template <typename PathIdTy>
+static vector<uint64_t> blockCounts(const DecodeTable<PathIdTy> &Table,
+                                    const common::PathTrie &Trie,
+                                    const vector<Path<PathIdTy>> &paths) {
+    vector<uint64_t> Counts(Table.Blocks.size(), 0);
+    for (auto N = common::PathTrie::Root + 1; N < Trie.size(); N++)
+        Counts[Trie.block(N)] += Trie.prefixCount(N);
+    for (auto &path : paths) {
+        if (path.type & RIFO)
+            Counts[Trie.block(path.node)] -= path.count;
+        if (path.type & FIRO)
+            Counts[Table.Entry] -= path.count;
+    }
+    return Counts;
+}
+
+// Write epp-hotness.txt, the dynamic execution counts of the blocks, loops
+// and loop nests of the function weighted by their number of instructions.
+// The instructions of a block are its count times its size, those of a loop
+// are the sum over its blocks, without (self) and with (total) the blocks
+// of its subloops. The iterations of a loop are the count of its header.
+template <typename PathIdTy>
+static void writeHotness(Function &F, LoopInfo &LI,
+                         const DecodeTable<PathIdTy> &Table,
+                         const vector<uint64_t> &Counts) {
+    struct LoopHotness {
+        uint64_t Iterations;
+        uint64_t Self;
+        uint64_t Total;
+    };
+    MapVector<Loop *, LoopHotness> Loops;
+    vector<pair<uint64_t, unsigned>> Blocks;
+    uint64_t FunctionIns = 0;
+
+    for (unsigned I = 0; I < Table.Blocks.size(); I++) {
+        auto *BB     = Table.Blocks[I];
+        uint64_t Ins = Counts[I] * Table.Summary[I].NumIns;
+        FunctionIns += Ins;
+        if (Counts[I])
+            Blocks.push_back({Ins, I});
+        auto *L = LI.getLoopFor(BB);
+        if (!L)
+            continue;
+        if (L->getHeader() == BB)
+            Loops[L].Iterations = Counts[I];
+        Loops[L].Self += Ins;
+        for (; L; L = L->getParentLoop())
+            Loops[L].Total += Ins;
+    }
+
+    ofstream Outfile("epp-hotness.txt", ios::out);
+    Outfile << "function " << F.getName().str() << " " << FunctionIns << "\n";
+
+    stable_sort(Blocks.begin(), Blocks.end(),
+                [](const pair<uint64_t, unsigned> &A,
+                   const pair<uint64_t, unsigned> &B) {
+                    return A.first > B.first;
+                });
+    for (auto &B : Blocks)
+        Outfile << "block " << Table.Blocks[B.second]->getName().str() << " "
+                << Counts[B.second] << " " << B.first << "\n";
+
+    vector<pair<Loop *, LoopHotness>> Sorted(Loops.begin(), Loops.end());
+    stable_sort(Sorted.begin(), Sorted.end(),
+                [](const pair<Loop *, LoopHotness> &A,
+                   const pair<Loop *, LoopHotness> &B) {
+                    return A.second.Total > B.second.Total;
+                });
+    for (auto &KV : Sorted)
+        Outfile << "loop " << KV.first->getHeader()->getName().str() << " "
+                << KV.first->getLoopDepth() << " " << KV.second.Iterations
+                << " " << KV.second.Self << " " << KV.second.Total << "\n";
+
+    // Loop nests are the outermost loops, with their share of the
+    // instructions of the function.
+    Outfile << fixed << setprecision(2);
+    for (auto &KV : Sorted)
+        if (KV.first->getLoopDepth() == 1)
+            Outfile << "nest " << KV.first->getHeader()->getName().str()
+                    << " " << KV.second.Total << " "
+                    << (FunctionIns ? 100.0 * KV.second.Total / FunctionIns
+                                    : 0.0)
+                    << "\n";
+}
+
+static string createRunFile() {
+    SmallString<128> Name;
+    if (sys::fs::createTemporaryFile("epp-run", "bin", Name))
+        report_fatal_error("Could not create a temporary file");
+    return Name.str().str();
+}
+
+// Merge sorted runs of paths into Sink and delete them.
+template <typename PathIdTy>
+static void
+mergeRuns(const vector<string> &Runs,
+          function<void(const common::SequenceRecord &)> Sink) {
+    typedef PathIdTraits<PathIdTy> Traits;
+    struct Head {
+        common::SequenceRecord R;
+        Path<PathIdTy> P;
+        size_t Run;
+    };
+    // The path which comes first in the output is at the top.
+    auto Later = [](const Head &A, const Head &B) {
+        return byCount(B.P, A.P);
+    };
+    priority_queue<Head, vector<Head>, decltype(Later)> Heap(Later);
+
+    vector<unique_ptr<common::SequenceReader>> Readers;
+    auto next = [&Readers, &Heap](size_t Run) {
+        Head H;
+        H.Run = Run;
+        if (!Readers[Run]->next(H.R))
+            return;
+        H.P.count = H.R.Freq;
+        if (!Traits::fromString(H.R.Id, H.P.id, 10))
+            report_fatal_error("Invalid path id in run");
+        Heap.push(move(H));
+    };
+    for (size_t I = 0; I < Runs.size(); I++) {
+        Readers.emplace_back(new common::SequenceReader(Runs[I]));
+        next(I);
+    }
+    while (!Heap.empty()) {
+        auto H = Heap.top();
+        Heap.pop();
+        Sink(H.R);
+        next(H.Run);
+    }
+
+    Readers.clear();
+    for (auto &Run : Runs)
+        sys::fs::remove(Run);
+}
+
+// Decode the profile with about Cap bytes for the decoded paths. The
+// profile is read in chunks which fit in the cap, each chunk is decoded,
+// sorted and written to a temporary file as a run, and the runs are merged
+// into the output, at most MaxFanIn runs at a time. Paths which cannot be
+// accelerated are dropped before they are written, after their blocks are
+// counted. Returns the number of times each block was executed.
+template <typename PathIdTy>
+static vector<uint64_t> decodeExternal(Function &F,
+                                       const DecodeTable<PathIdTy> &Table,
+                                       istream &inFile, uint64_t Cap) {
+    typedef PathIdTraits<PathIdTy> Traits;
+    typedef pair<Path<PathIdTy>, vector<unsigned>> Decoded;
+
+    vector<uint64_t> Counts(Table.Blocks.size(), 0);
+
+    auto toRecord = [](const Decoded &D) {
+        auto &P = D.first;
+        return common::SequenceRecord{
+            Traits::toString(P.id), P.count, static_cast<uint32_t>(P.type),
+            P.numIns, vector<uint32_t>(D.second.begin(), D.second.end())};
+    };
+
+    // The blocks of a batch are only known once it is decoded, so a batch
+    // is as large as the paths which fit in the rest of the cap if all of
+    // them were as long as the longest path.
+    const uint64_t PathBytes =
+        sizeof(Decoded) + maxBlocks(Table) * sizeof(unsigned);
+
+    vector<string> Runs;
+    vector<Decoded> Chunk;
+    bool Done = false;
+    while (!Done) {
+        Chunk.clear();
+        uint64_t BlockBytes = 0;
+        PathIdTy PathId;
+        uint64_t PathCount;
+        auto used = [&Chunk, &BlockBytes]() {
+            return Chunk.size() * sizeof(Decoded) + BlockBytes;
+        };
+        while (!Done && used() < Cap) {
+            size_t Start = Chunk.size();
+            size_t Batch = max<uint64_t>(
+                1, min<uint64_t>(BatchSize, (Cap - used()) / PathBytes));
+            while (Chunk.size() - Start < Batch) {
+                if (!readPath(inFile, PathId, PathCount)) {
+                    Done = true;
+                    break;
+                }
+                Chunk.push_back({{&F, PathId, PathCount}, {}});
+            }
+            common::parallelFor(
+                Chunk.size() - Start, numThreads,
+                [&Chunk, &Table, Start](size_t Begin, size_t End) {
+                    for (size_t I = Begin; I < End; I++) {
+                        auto &D        = Chunk[Start + I];
+                        auto Blocks    = EPPDecode::decode(D.first.id, Table);
+                        D.first.type   = Blocks.first;
+                        D.second       = trimPath(Blocks);
+                        D.first.numIns = Table.pathCheck(D.second);
+                    }
+                });
+            for (size_t I = Start; I < Chunk.size(); I++) {
+                auto &D = Chunk[I];
+                for (auto B : D.second)
+                    Counts[B] += D.first.count;
+                if (!D.first.numIns)
+                    vector<unsigned>().swap(D.second);
+                BlockBytes += D.second.capacity() * sizeof(unsigned);
+            }
+        }
+
+        Chunk.erase(remove_if(Chunk.begin(), Chunk.end(),
+                              [](const Decoded &D) {
+                                  return !D.first.numIns;
+                              }),
+                    Chunk.end());
+        common::parallelSort(Chunk.begin(), Chunk.end(), numThreads,
+                             [](const Decoded &A, const Decoded &B) {
+                                 return byCount(A.first, B.first);
+                             });
+
+        // A profile which fits in a single chunk is written directly.
+        if (Done && Runs.empty()) {
+            SequenceOutput<PathIdTy> Out(Table);
+            for (auto &D : Chunk)
+                Out.write(toRecord(D));
+            return Counts;
+        }
+
+        Runs.push_back(createRunFile());
+        common::SequenceWriter Writer(Runs.back());
+        for (auto &D : Chunk)
+            Writer.write(toRecord(D));
+    }
+    Chunk.clear();
+    Chunk.shrink_to_fit();
+    DEBUG(errs() << "Sorted runs : " << Runs.size() << "\n");
+
+    while (Runs.size() > MaxFanIn) {
+        vector<string> Merged;
+        for (size_t I = 0; I < Runs.size(); I += MaxFanIn) {
+            auto End = min(I + MaxFanIn, Runs.size());
+            vector<string> Group(Runs.begin() + I, Runs.begin() + End);
+            Merged.push_back(createRunFile());
+            common::SequenceWriter Writer(Merged.back());
+            mergeRuns<PathIdTy>(Group,
+                                [&Writer](const common::SequenceRecord &R) {
+                                    Writer.write(R);
+                                });
+        }
+        Runs = move(Merged);
+    }
+
+    SequenceOutput<PathIdTy> Out(Table);
+    mergeRuns<PathIdTy>(
+        Runs, [&Out](const common::SequenceRecord &R) { Out.write(R); });
+    return Counts;
+}
+
+bool EPPDecode::runOnModule(Module &M) {
+    ifstream inFile(profile.c_str(), ios::in);
+    assert(inFile.is_open() && "Could not open file for reading");
+
+    for (auto &F : M) {
+        if (isTargetFunction(F, FunctionList)) {
+            auto &Enc = getAnalysis<EPPEncode>(F);
+            auto *LI  = Enc.LI;
+            Enc.visit([this, &F, LI, &inFile](auto &E) {
+                if (traceProfile)
+                    decodeTrace(F, E, *LI, inFile);
+                else
+                    decodeProfile(F, E, *LI, inFile);
+            });
+        }
+    }
+    inFile.close();
 
     return false;
 }
 
-pair<PathType, vector<llvm::BasicBlock *>>
-EPPDecode::decode(Function &F, APInt pathID, EPPEncode &Enc) {
-    vector<llvm::BasicBlock *> Sequence;
-    auto *Position = &F.getEntryBlock();
-    auto &ACFG     = Enc.ACFG;
+template <typename PathIdTy>
+void EPPDecode::decodeProfile(Function &F, Encoding<PathIdTy> &Enc,
+                              LoopInfo &LI, istream &inFile) {
+    typedef PathIdTraits<PathIdTy> Traits;
 
-    DEBUG(errs() << "Decode Called On: " << pathID << "\n");
+    uint64_t totalPathCount;
+    inFile >> totalPathCount;
+    if (!replayRegion.empty())
+        errs() << "Warning : -replay requires -trace\n";
+
+    DecodeTable<PathIdTy> Table(F, Enc);
+    common::PathTrie Trie;
+    vector<Path<PathIdTy>> paths;
+
+    if (numTop) {
+        paths = topPaths(F, Table, Trie, inFile, numTop);
+    } else if (decodeMemory) {
+        auto Counts =
+            decodeExternal(F, Table, inFile, decodeMemory * (1ULL << 20));
+        writeHotness(F, LI, Table, Counts);
+        return;
+    } else {
+        paths.reserve(totalPathCount);
+
+        PathIdTy PathId;
+        uint64_t PathCount;
+        while (readPath(inFile, PathId, PathCount))
+            paths.push_back({&F, PathId, PathCount});
+
+        // The table is only read while decoding, so the paths of a batch
+        // can be decoded and checked in parallel. The trie is not, so the
+        // batch is then added to it by a single thread. Only the current
+        // batch is held as vectors of blocks.
+        vector<pair<PathType, vector<unsigned>>> Decoded;
+        for (size_t B = 0; B < paths.size(); B += BatchSize) {
+            size_t N = min(BatchSize, paths.size() - B);
+            Decoded.resize(N);
+            common::parallelFor(
+                N, numThreads,
+                [&paths, &Table, &Decoded, B](size_t Begin, size_t End) {
+                    for (size_t I = Begin; I < End; I++) {
+                        auto &path  = paths[B + I];
+                        Decoded[I]  = decode(path.id, Table);
+                        path.type   = Decoded[I].first;
+                        path.numIns = Table.pathCheck(trimPath(Decoded[I]));
+                    }
+                });
+            for (size_t I = 0; I < N; I++) {
+                auto &path = paths[B + I];
+                path.node  = Trie.insert(Decoded[I].second);
+                Trie.add(path.node, path.count);
+            }
+        }
+        DEBUG(errs() << "Trie nodes : " << Trie.size() << "\n");
+
+        sortByCount(paths);
+        writeHotness(F, LI, Table, blockCounts(Table, Trie, paths));
+    }
+
+    writePaths(Table, Trie, paths);
+}
+
+template <typename PathIdTy>
+void EPPDecode::decodeTrace(Function &F, Encoding<PathIdTy> &Enc,
+                            LoopInfo &LI, istream &inFile) {
+    typedef PathIdTraits<PathIdTy> Traits;
+
+    DecodeTable<PathIdTy> Table(F, Enc);
+    common::PathTrie Trie;
+    vector<Path<PathIdTy>> paths;
+
+    // Each distinct path is decoded once, the cache maps its id to its index
+    // in paths.
+    auto Less = [](const PathIdTy &A, const PathIdTy &B) {
+        return !Traits::ule(B, A);
+    };
+    map<PathIdTy, unsigned, decltype(Less)> Cache(Less);
+
+    // Number of runs and longest run of each path, indexed like paths.
+    vector<pair<uint64_t, uint64_t>> Runs;
+    // Number of runs by the log2 of their length.
+    vector<uint64_t> RunHist(64, 0);
+    uint64_t Executions = 0, NumRuns = 0;
+
+    // Blocks of each path without its fake endpoints, indexed like paths.
+    unique_ptr<TraceReplay> Replay;
+    vector<vector<unsigned>> Trimmed;
+    if (!replayRegion.empty())
+        Replay.reset(new TraceReplay(replayRegion, Table.Blocks));
+
+    // Executions of the paths in the current window, which is written out
+    // as a sparse vector of path ids and counts once it is full.
+    ofstream Windows;
+    if (traceWindow)
+        Windows.open("epp-trace-windows.txt", ios::out);
+    vector<uint64_t> WindowCount;
+    vector<unsigned> WindowPaths;
+    uint64_t WindowFill = 0, WindowIndex = 0;
+    auto flushWindow = [&]() {
+        sort(WindowPaths.begin(), WindowPaths.end());
+        Windows << WindowIndex << " " << WindowFill;
+        for (auto P : WindowPaths) {
+            Windows << " " << Traits::toString(paths[P].id) << ":"
+                    << WindowCount[P];
+            WindowCount[P] = 0;
+        }
+        Windows << "\n";
+        WindowPaths.clear();
+        WindowFill = 0;
+        WindowIndex++;
+    };
+
+    PathIdTy PathId;
+    uint64_t RunLength;
+    while (readPath(inFile, PathId, RunLength)) {
+        if (!RunLength)
+            continue;
+
+        unsigned P;
+        auto It = Cache.find(PathId);
+        if (It == Cache.end()) {
+            P = paths.size();
+            Cache.insert({PathId, P});
+            Path<PathIdTy> Q = {&F, PathId, 0};
+            auto Blocks      = decode(PathId, Table);
+            Q.type           = Blocks.first;
+            Q.numIns         = Table.pathCheck(trimPath(Blocks));
+            Q.node           = Trie.insert(Blocks.second);
+            paths.push_back(Q);
+            Runs.push_back({0, 0});
+            WindowCount.push_back(0);
+            if (Replay)
+                Trimmed.push_back(trimPath(Blocks));
+        } else {
+            P = It->second;
+        }
+
+        paths[P].count += RunLength;
+        Trie.add(paths[P].node, RunLength);
+        Runs[P].first++;
+        Runs[P].second = max(Runs[P].second, RunLength);
+        RunHist[Log2_64(RunLength)]++;
+        Executions += RunLength;
+        NumRuns++;
+        if (Replay)
+            Replay->run(Trimmed[P], RunLength);
+
+        // A long run can span several windows.
+        while (traceWindow && RunLength) {
+            uint64_t N = min<uint64_t>(RunLength, traceWindow - WindowFill);
+            if (!WindowCount[P])
+                WindowPaths.push_back(P);
+            WindowCount[P] += N;
+            WindowFill += N;
+            RunLength -= N;
+            if (WindowFill == traceWindow)
+                flushWindow();
+        }
+    }
+    if (WindowFill)
+        flushWindow();
+    Windows.close();
+    if (numPhases) {
+        if (traceWindow)
+            detectPhases("epp-trace-windows.txt", numPhases);
+        else
+            errs() << "Warning : -phases requires -trace-window\n";
+    }
+
+    errs() << "Executions : " << Executions << " Runs : " << NumRuns
+           << " Paths : " << paths.size() << "\n";
+    for (unsigned I = 0; I < RunHist.size(); I++)
+        if (RunHist[I])
+            errs() << "Runs of length [" << (1ULL << I) << ", "
+                   << (2ULL << I) - 1 << "] : " << RunHist[I] << "\n";
+
+    // Run statistics of each path, in the order of the paths in the trace.
+    ofstream RunFile("epp-trace-runs.txt", ios::out);
+    for (unsigned P = 0; P < paths.size(); P++)
+        RunFile << Traits::toString(paths[P].id) << " " << paths[P].count
+                << " " << Runs[P].first << " " << Runs[P].second << "\n";
+
+    if (Replay)
+        Replay->write();
+
+    sortByCount(paths);
+    writeHotness(F, LI, Table, blockCounts(Table, Trie, paths));
+    if (numTop)
+        paths = hotPaths(Trie, paths, numTop);
+    writePaths(Table, Trie, paths);
+}
+
+template <typename PathIdTy>
+DecodeTable<PathIdTy>::DecodeTable(Function &F, Encoding<PathIdTy> &Enc) {
+    typedef PathIdTraits<PathIdTy> Traits;
+    auto &ACFG = Enc.ACFG;
+
+    DenseMap<BasicBlock *, unsigned> Index;
+    for (auto &BB : F) {
+        Index[&BB] = Blocks.size();
+        Blocks.push_back(&BB);
+        Summary.push_back(summarizeBlock(&BB));
+        Ids.push_back(getBlockId(&BB));
+        Exiting.push_back(isFunctionExiting(&BB));
+    }
+    Entry = Index[&F.getEntryBlock()];
+
+    auto &FakeEdges = ACFG.getFakeEdges();
+    vector<pair<PathIdTy, BasicBlock *>> Out;
+    for (auto *BB : Blocks) {
+        Begin.push_back(Weights.size());
+        if (!ACFG.contains(BB))
+            continue;
+        Out.clear();
+        for (auto *Tgt : ACFG.succs(BB))
+            Out.push_back({ACFG[{BB, Tgt}], Tgt});
+        stable_sort(Out.begin(), Out.end(),
+                    [](const pair<PathIdTy, BasicBlock *> &A,
+                       const pair<PathIdTy, BasicBlock *> &B) {
+                        return !Traits::ule(B.first, A.first);
+                    });
+        for (auto &O : Out) {
+            Weights.push_back(O.first);
+            Succs.push_back(Index[O.second]);
+            Fake.push_back(FakeEdges.count({BB, O.second}));
+        }
+    }
+    Begin.push_back(Weights.size());
+}
 
-    vector<Edge> SelectedEdges;
+template <typename PathIdTy>
+pair<PathType, vector<unsigned>>
+EPPDecode::decode(PathIdTy pathID, const DecodeTable<PathIdTy> &T) {
+    typedef PathIdTraits<PathIdTy> Traits;
+    vector<unsigned> Sequence;
+    auto Position = T.Entry;
+
+    DEBUG(errs() << "Decode Called On: " << Traits::toString(pathID) << "\n");
+
+    // Indices of the first and last selected edges.
+    unsigned First = ~0U, Last = ~0U;
     while (true) {
         Sequence.push_back(Position);
-        if (isFunctionExiting(Position))
+        if (T.Exiting[Position])
             break;
-        APInt Wt(128, 0, true);
-        Edge Select = {nullptr, nullptr};
-        DEBUG(errs() << Position->getName() << " (\n");
-        for (auto *Tgt : ACFG.succs(Position)) {
-            auto EWt = ACFG[{Position, Tgt}];
-            DEBUG(errs() << "\t" << Tgt->getName() << " [" << EWt << "]\n");
-            if (ACFG[{Position, Tgt}].uge(Wt) &&
-                ACFG[{Position, Tgt}].ule(pathID)) {
-                Select = {Position, Tgt};
-                Wt     = ACFG[{Position, Tgt}];
-            }
-        }
-        DEBUG(errs() << " )\n\n\n");
-
-        SelectedEdges.push_back(Select);
-        Position = TGT(Select);
-        pathID -= Wt;
+        auto B = T.Weights.begin() + T.Begin[Position],
+             E = T.Weights.begin() + T.Begin[Position + 1];
+        // The first edge whose weight exceeds the path id, the selected edge
+        // is the one before it. The first edge of a block has weight 0.
+        auto It = upper_bound(B, E, pathID,
+                              [](const PathIdTy &V, const PathIdTy &W) {
+                                  return !Traits::ule(W, V);
+                              });
+        if (It == B)
+            break;
+        unsigned Select = It - T.Weights.begin() - 1;
+        DEBUG(errs() << T.Blocks[Position]->getName() << " -> "
+                     << T.Blocks[T.Succs[Select]]->getName() << " ["
+                     << Traits::toString(T.Weights[Select]) << "]\n");
+
+        if (First == ~0U)
+            First = Select;
+        Last     = Select;
+        Position = T.Succs[Select];
+        pathID   = pathID - T.Weights[Select];
     }
 
-    if (SelectedEdges.empty())
+    if (First == ~0U)
         return {RIRO, Sequence};
 
-    auto FakeEdges = ACFG.getFakeEdges();
-
 #define SET_BIT(n, x) (n |= 1ULL << x)
     uint64_t Type = 0;
-    if (FakeEdges.count(SelectedEdges.front())) {
+    if (T.Fake[First]) {
         SET_BIT(Type, 0);
     }
-    if (FakeEdges.count(SelectedEdges.back())) {
+    if (T.Fake[Last]) {
         SET_BIT(Type, 1);
     }
 #undef SET_BIT
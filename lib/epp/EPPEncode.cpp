@@ -4,13 +4,17 @@
 #include "llvm/ADT/PostOrderIterator.h"
 #include "llvm/ADT/SCCIterator.h"
 #include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/CFG.h"
+#include "llvm/IR/DebugInfoMetadata.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/Pass.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/Scalar.h"
 
@@ -18,6 +22,7 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <fstream>
 #include <set>
 #include <stack>
@@ -28,12 +33,32 @@ using namespace llvm;
 using namespace epp;
 using namespace std;
 
+extern cl::list<std::string> FunctionList;
+extern bool isTargetFunction(const Function &f,
+                             const cl::list<std::string> &FunctionList);
 extern cl::opt<bool> wideCounter;
+extern cl::opt<string> encodingCache;
+extern cl::opt<bool> autoCut;
+extern cl::opt<bool> collapse;
+extern cl::opt<string> loopName;
 
-bool EPPEncode::doInitialization(Module &m) { return false; }
-bool EPPEncode::doFinalization(Module &m) { return false; }
+bool EPPEncode::doInitialization(Module &m) {
+    CacheDirty = false;
+    if (!encodingCache.empty() && !readEncodingCache(encodingCache, Cache))
+        Cache.clear();
+    return false;
+}
+
+bool EPPEncode::doFinalization(Module &m) {
+    if (CacheDirty)
+        writeEncodingCache(encodingCache, Cache);
+    return false;
+}
 
 bool EPPEncode::runOnFunction(Function &func) {
+    // Only the functions being profiled need to be encoded.
+    if (!isTargetFunction(func, FunctionList))
+        return false;
     LI = &getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
     encode(func);
     return false;
@@ -47,23 +72,36 @@ static bool isFunctionExiting(BasicBlock *BB) {
 }
 
 void EPPEncode::releaseMemory() {
-    LI = nullptr;
-    numPaths.clear();
-    ACFG.clear();
+    LI     = nullptr;
+    isWide = false;
+    Narrow.clear();
+    Wide.clear();
 }
 
-void EPPEncode::encode(Function &F) {
-    DEBUG(errs() << "Called Encode on " << F.getName() << "\n");
-
-    auto POB   = common::postOrder(F, LI);
-    auto Entry = POB.back(), Exit = POB.front();
-    auto BackEdges = common::getBackEdges(F);
+// Add the edges of the function to the alternate CFG in post order, the
+// edges for which isSegmented returns true are replaced by fake edges. Only
+// the half outside of the region is added for edges entering or leaving a
+// collapsed region, and the edges within it are left out.
+template <typename PathIdTy, typename SegmentFn>
+static void addEdges(Encoding<PathIdTy> &Enc, vector<BasicBlock *> &POB,
+                     SegmentFn isSegmented) {
+    auto &ACFG = Enc.ACFG;
+    auto Entry = Enc.Entry, Exit = Enc.Exit;
 
-    // Add real edges
     for (auto &BB : POB) {
         for (auto S = succ_begin(BB), E = succ_end(BB); S != E; S++) {
-            if (BackEdges.count(make_pair(BB, *S)) ||
-                LI->getLoopFor(BB) != LI->getLoopFor(*S)) {
+            bool SrcIn = Enc.Collapsed.count(BB),
+                 TgtIn = Enc.Collapsed.count(*S);
+            if (SrcIn && TgtIn)
+                continue;
+            if (SrcIn || TgtIn) {
+                DEBUG(errs() << "Adding collapsed edge : " << BB->getName()
+                             << " " << S->getName() << "\n");
+                ACFG.add(BB, *S, SrcIn ? Entry : nullptr,
+                         TgtIn ? Exit : nullptr);
+                continue;
+            }
+            if (isSegmented(BB, *S)) {
                 DEBUG(errs() << "Adding segmented edge : " << BB->getName()
                              << " " << S->getName() << " " << Entry->getName()
                              << " " << Exit->getName() << "\n");
@@ -75,34 +113,379 @@ void EPPEncode::encode(Function &F) {
             ACFG.add(BB, *S);
         }
     }
+}
+
+// Build the alternate CFG and compute the edge weights with path ids of type
+// PathIdTy, the edges for which isSegmented returns true are replaced by
+// fake edges. Returns false if the number of paths does not fit in PathIdTy.
+template <typename PathIdTy, typename SegmentFn>
+static bool encodeAs(Encoding<PathIdTy> &Enc, vector<BasicBlock *> &POB,
+                     const DenseSet<BasicBlock *> &Collapsed,
+                     SegmentFn isSegmented) {
+    typedef PathIdTraits<PathIdTy> Traits;
+    auto &ACFG     = Enc.ACFG;
+    auto &numPaths = Enc.numPaths;
+    auto Entry = POB.back();
+    Enc.Entry     = Entry;
+    Enc.Exit      = POB.front();
+    Enc.Collapsed = Collapsed;
+
+    addEdges(Enc, POB, isSegmented);
 
     for (auto &B : POB) {
-        APInt pathCount(128, 0, true);
+        // Entry and Exit are the endpoints of the fake edges even when they
+        // are collapsed, Exit may be left without edges though.
+        if (Collapsed.count(B) && B != Entry && B != Enc.Exit)
+            continue;
+
+        auto pathCount = Traits::get(0);
 
         if (isFunctionExiting(B))
-            pathCount = 1;
+            pathCount = Traits::get(1);
+
+        if (!ACFG.contains(B)) {
+            numPaths.insert({B, pathCount});
+            continue;
+        }
 
         for (auto &S : ACFG.succs(B)) {
             ACFG[{B, S}] = pathCount;
             if (numPaths.count(S) == 0)
-                numPaths.insert(make_pair(S, APInt(128, 0, true)));
+                numPaths.insert(make_pair(S, Traits::get(0)));
 
             // This is the only place we need to check for overflow.
-            bool Ov   = false;
-            pathCount = pathCount.sadd_ov(numPaths[S], Ov);
-            if (Ov) {
-                report_fatal_error("Integer Overflow");
-            }
+            if (Traits::addOv(pathCount, numPaths[S], pathCount))
+                return false;
         }
         numPaths.insert({B, pathCount});
     }
 
-    if (numPaths[Entry].getLimitedValue() == ~0ULL && !wideCounter) {
-        report_fatal_error(
-            "Numpaths greater than 2^64, please use -use-wide-counter option");
+    errs() << "NumPaths : " << Traits::toString(numPaths[Entry]) << "\n";
+    return true;
+}
+
+// Blocks which are the target of a fake edge from Entry.
+template <typename SegmentFn>
+static DenseSet<BasicBlock *> getStarts(vector<BasicBlock *> &POB,
+                                        SegmentFn isSegmented) {
+    DenseSet<BasicBlock *> Starts;
+    for (auto &BB : POB)
+        for (auto S = succ_begin(BB), E = succ_end(BB); S != E; S++)
+            if (isSegmented(BB, *S))
+                Starts.insert(*S);
+    return Starts;
+}
+
+// Number of paths from each block to Exit in double precision, so that it
+// can be estimated for functions whose paths do not fit in any counter.
+template <typename SegmentFn>
+static DenseMap<BasicBlock *, double>
+countPaths(vector<BasicBlock *> &POB, SegmentFn isSegmented,
+           const DenseSet<BasicBlock *> &Starts) {
+    auto Entry = POB.back();
+    DenseMap<BasicBlock *, double> Down;
+    for (auto &BB : POB) {
+        double N = isFunctionExiting(BB) ? 1.0 : 0.0;
+        for (auto S = succ_begin(BB), E = succ_end(BB); S != E; S++)
+            N += isSegmented(BB, *S) ? 1.0 : Down[*S];
+        if (BB == Entry)
+            for (auto &S : Starts)
+                N += Down[S];
+        Down[BB] = N;
+    }
+    return Down;
+}
+
+double epp::estimatePaths(Function &F, LoopInfo *LI) {
+    auto POB       = common::postOrder(F, LI);
+    auto BackEdges = common::getBackEdges(F);
+    auto isSegmented = [&BackEdges, LI](BasicBlock *Src, BasicBlock *Tgt) {
+        return BackEdges.count(make_pair(Src, Tgt)) ||
+               LI->getLoopFor(Src) != LI->getLoopFor(Tgt);
+    };
+    auto Down = countPaths(POB, isSegmented, getStarts(POB, isSegmented));
+    return Down[POB.back()];
+}
+
+// Greedily pick blocks to cut until the number of paths, estimated in double
+// precision, is below 2^Bits. Cutting a block segments all the edges entering
+// it, so the paths reaching it end with a fake edge to Exit and new paths
+// start at it with a fake edge from Entry. Each step picks the block where
+// this removes the most paths, which are typically merge points with many
+// paths both entering and leaving them. Returns false if no cut reduces the
+// number of paths any further.
+template <typename SegmentFn>
+static bool selectCuts(vector<BasicBlock *> &POB, SegmentFn isSegmented,
+                       unsigned Bits, DenseSet<BasicBlock *> &Cuts) {
+    auto Entry = POB.back(), Exit = POB.front();
+    const double Limit = ldexp(1.0, Bits);
+
+    while (true) {
+        auto Starts = getStarts(POB, isSegmented);
+        auto Down   = countPaths(POB, isSegmented, Starts);
+
+        if (Down[Entry] < Limit)
+            return true;
+
+        // Paths from Entry to each block, and the part of them which reach
+        // the block through real edges.
+        DenseMap<BasicBlock *, double> Up, In;
+        Up[Entry] = 1.0;
+        for (auto &S : Starts)
+            Up[S] += 1.0;
+        for (auto I = POB.rbegin(), IE = POB.rend(); I != IE; I++) {
+            auto *BB = *I;
+            for (auto S = succ_begin(BB), E = succ_end(BB); S != E; S++) {
+                if (isSegmented(BB, *S))
+                    continue;
+                Up[*S] += Up[BB];
+                In[*S] += Up[BB];
+            }
+        }
+
+        BasicBlock *Best = nullptr;
+        double BestGain  = 0.0;
+        for (auto &BB : POB) {
+            if (BB == Entry || BB == Exit || Cuts.count(BB) || In[BB] == 0.0)
+                continue;
+            auto Gain = In[BB] * Down[BB] - In[BB] -
+                        (Starts.count(BB) ? 0.0 : Down[BB]);
+            if (Gain > BestGain) {
+                Best     = BB;
+                BestGain = Gain;
+            }
+        }
+
+        if (!Best)
+            return false;
+
+        DEBUG(errs() << "Cutting at " << Best->getName() << " : " << BestGain
+                     << "\n");
+        Cuts.insert(Best);
+    }
+}
+
+// Find the loop named by -epp-loop, either by the name of its header or by
+// the source line where it starts, optionally prefixed with the file name.
+static Loop *findLoop(LoopInfo *LI, StringRef Spec) {
+    StringRef File, LineStr;
+    tie(File, LineStr) = Spec.rsplit(':');
+    if (LineStr.empty())
+        swap(File, LineStr);
+    unsigned Line = 0;
+    bool ByLine   = !LineStr.getAsInteger(10, Line);
+
+    for (auto *L : common::getLoops(LI)) {
+        if (L->getHeader()->getName() == Spec)
+            return L;
+        auto DL = L->getStartLoc();
+        if (!ByLine || !DL || DL.getLine() != Line)
+            continue;
+        if (File.empty() ||
+            cast<DIScope>(DL.getScope())->getFilename().endswith(File))
+            return L;
+    }
+    return nullptr;
+}
+
+// Hash of the preprocessed function and the options which change the
+// encoding, used to key the encoding cache.
+static string hashFunction(Function &F) {
+    string Str;
+    raw_string_ostream OS(Str);
+    F.print(OS);
+    OS << "wide " << wideCounter.getValue() << "\n";
+    OS << "cut " << autoCut.getValue() << "\n";
+    OS << "collapse " << collapse.getValue() << "\n";
+    OS << "loop " << loopName.getValue() << "\n";
+    OS.flush();
+
+    MD5 Hash;
+    Hash.update(Str);
+    MD5::MD5Result Result;
+    Hash.final(Result);
+    SmallString<32> Hex;
+    MD5::stringifyResult(Result, Hex);
+    return Hex.str().str();
+}
+
+// Rebuild the encoding of F from a cache entry. The alternate CFG is built
+// by adding the edges in the same order as encodeAs so that the increments
+// computed from it are identical.
+template <typename PathIdTy>
+static bool loadAs(Encoding<PathIdTy> &Enc, const EncodingCacheEntry &Cached,
+                   Function &F, vector<BasicBlock *> &POB,
+                   const DenseSet<BasicBlock *> &Collapsed) {
+    typedef PathIdTraits<PathIdTy> Traits;
+    auto Entry    = POB.back();
+    Enc.Entry     = Entry;
+    Enc.Exit      = POB.front();
+    Enc.Collapsed = Collapsed;
+
+    StringMap<BasicBlock *> Blocks;
+    for (auto &BB : F)
+        Blocks[BB.getName()] = &BB;
+
+    DenseSet<Edge> Segmented;
+    for (auto &S : Cached.Segments) {
+        auto *Src = Blocks.lookup(S.first), *Tgt = Blocks.lookup(S.second);
+        if (!Src || !Tgt)
+            return false;
+        Segmented.insert({Src, Tgt});
     }
 
-    errs() << "NumPaths : " << numPaths[Entry] << "\n";
+    addEdges(Enc, POB, [&Segmented](BasicBlock *Src, BasicBlock *Tgt) {
+        return Segmented.count({Src, Tgt});
+    });
+
+    for (auto &P : Cached.NumPaths) {
+        auto *BB = Blocks.lookup(P.first);
+        PathIdTy Val;
+        if (!BB || !Traits::fromString(P.second, Val))
+            return false;
+        Enc.numPaths[BB] = Val;
+    }
+
+    for (auto &W : Cached.Weights) {
+        auto *Src = Blocks.lookup(get<0>(W)), *Tgt = Blocks.lookup(get<1>(W));
+        PathIdTy Val;
+        if (!Src || !Tgt || !Traits::fromString(get<2>(W), Val))
+            return false;
+        Enc.ACFG[{Src, Tgt}] = Val;
+    }
+
+    errs() << "NumPaths : " << Traits::toString(Enc.numPaths[Entry])
+           << " (cached)\n";
+    return true;
+}
+
+template <typename PathIdTy>
+static bool saveAs(Encoding<PathIdTy> &Enc, EncodingCacheEntry &Cached,
+                   Function &F) {
+    typedef PathIdTraits<PathIdTy> Traits;
+
+    // Blocks are identified by name in the cache.
+    for (auto &BB : F)
+        if (!BB.hasName())
+            return false;
+
+    for (auto &KV : Enc.ACFG.getSegments())
+        Cached.Segments.push_back(
+            {SRC(KV.first)->getName().str(), TGT(KV.first)->getName().str()});
+
+    for (auto &BB : F)
+        if (Enc.numPaths.count(&BB))
+            Cached.NumPaths.push_back(
+                {BB.getName().str(), Traits::toString(Enc.numPaths[&BB], 16)});
+
+    for (auto &E : Enc.ACFG.getEdges())
+        Cached.Weights.push_back(make_tuple(SRC(E)->getName().str(),
+                                            TGT(E)->getName().str(),
+                                            Traits::toString(Enc.ACFG[E], 16)));
+    return true;
+}
+
+void EPPEncode::encode(Function &F) {
+    DEBUG(errs() << "Called Encode on " << F.getName() << "\n");
+
+    auto POB       = common::postOrder(F, LI);
+    auto BackEdges = common::getBackEdges(F);
+
+    DenseSet<BasicBlock *> Collapsed;
+
+    // Only the selected loop is profiled, everything outside of it is
+    // collapsed, including the function entry and exit.
+    if (!loopName.empty()) {
+        auto *L = findLoop(LI, loopName);
+        if (!L)
+            report_fatal_error("Could not find the loop to profile");
+        for (auto &BB : POB)
+            if (!L->contains(BB))
+                Collapsed.insert(BB);
+        errs() << "Loop : " << L->getHeader()->getName() << "\n";
+    }
+
+    // Paths through blocks which cannot be accelerated are discarded after
+    // decoding, so there is no need to tell them apart. The function entry
+    // and exit are not collapsed here so that whole paths are still seen.
+    if (collapse) {
+        for (auto &BB : POB)
+            if (BB != POB.back() && BB != POB.front() &&
+                !common::isAcceleratable(BB))
+                Collapsed.insert(BB);
+        errs() << "Collapsed : " << Collapsed.size() << "\n";
+    }
+
+    string Hash;
+    if (!encodingCache.empty()) {
+        Hash    = hashFunction(F);
+        auto It = Cache.find(F.getName().str());
+        if (It != Cache.end() && It->second.Hash == Hash) {
+            isWide      = It->second.Wide;
+            auto Loaded = isWide
+                              ? loadAs(Wide, It->second, F, POB, Collapsed)
+                              : loadAs(Narrow, It->second, F, POB, Collapsed);
+            if (Loaded)
+                return;
+            DEBUG(errs() << "Invalid cache entry for " << F.getName() << "\n");
+            Narrow.clear();
+            Wide.clear();
+        }
+    }
+
+    DenseSet<BasicBlock *> Cuts;
+    // Edges touching a collapsed block are handled by encodeAs, they are
+    // reported as segmented here so that selectCuts treats them the same.
+    auto isSegmented = [&BackEdges, &Cuts, &Collapsed, this](BasicBlock *Src,
+                                                             BasicBlock *Tgt) {
+        return BackEdges.count(make_pair(Src, Tgt)) ||
+               LI->getLoopFor(Src) != LI->getLoopFor(Tgt) || Cuts.count(Tgt) ||
+               Collapsed.count(Src) || Collapsed.count(Tgt);
+    };
+
+    if (autoCut) {
+        // Cut the CFG until the paths fit in the counter, the estimate may
+        // be slightly off so tighten the bound until the encoding fits.
+        isWide = wideCounter;
+        for (unsigned Bits = isWide ? 128 : 64; true; Bits--) {
+            if (Bits == 0 || !selectCuts(POB, isSegmented, Bits, Cuts))
+                report_fatal_error("Could not cut the CFG to fit the counter");
+            if (isWide ? encodeAs(Wide, POB, Collapsed, isSegmented)
+                       : encodeAs(Narrow, POB, Collapsed, isSegmented))
+                break;
+            Narrow.clear();
+            Wide.clear();
+        }
+        errs() << "Cuts : " << Cuts.size() << "\n";
+    } else {
+        // Use the narrowest path id which can hold the number of paths
+        // through the function, the increments are computed modulo the width
+        // of the counter so a wide counter always needs wide path ids.
+        isWide = wideCounter;
+        if (!isWide && !encodeAs(Narrow, POB, Collapsed, isSegmented)) {
+            DEBUG(errs()
+                  << "Numpaths greater than 2^64, using wide path ids\n");
+            Narrow.clear();
+            isWide = true;
+        }
+
+        if (isWide && !encodeAs(Wide, POB, Collapsed, isSegmented)) {
+            report_fatal_error(
+                "Integer Overflow, please use -epp-auto-cut option");
+        }
+    }
+
+    if (!encodingCache.empty()) {
+        EncodingCacheEntry Entry;
+        Entry.Hash  = Hash;
+        Entry.Wide  = isWide;
+        auto Stored =
+            isWide ? saveAs(Wide, Entry, F) : saveAs(Narrow, Entry, F);
+        if (Stored) {
+            Cache[F.getName().str()] = Entry;
+            CacheDirty               = true;
+        }
+    }
 }
 
 char EPPEncode::ID = 0;
@@ -0,0 +1,177 @@
+#define DEBUG_TYPE "epp_estimate"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/BranchProbabilityInfo.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "EPPDecode.h"
+#include "EPPEstimate.h"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <vector>
+
+using namespace llvm;
+using namespace epp;
+using namespace std;
+
+extern cl::list<string> FunctionList;
+extern bool isTargetFunction(const Function &, const cl::list<string> &);
+extern cl::opt<unsigned> numEstimates;
+
+// Upper bound on the number of partial paths explored in a function.
+static const size_t MaxStates = 1 << 20;
+
+// Counts are written per million calls of the function.
+static const double CountScale = 1e6;
+
+bool EPPEstimate::runOnModule(Module &M) {
+    ofstream Outfile("epp-sequences.txt", ios::out);
+
+    for (auto &F : M) {
+        if (isTargetFunction(F, FunctionList)) {
+            auto &Enc = getAnalysis<EPPEncode>(F);
+            auto *LI  = Enc.LI;
+            Enc.visit([this, &F, LI, &Outfile](auto &E) {
+                estimate(F, E, *LI, Outfile);
+            });
+        }
+    }
+
+    return false;
+}
+
+template <typename PathIdTy>
+void EPPEstimate::estimate(Function &F, Encoding<PathIdTy> &Enc, LoopInfo &LI,
+                           ofstream &Outfile) {
+    typedef PathIdTraits<PathIdTy> Traits;
+    auto &ACFG = Enc.ACFG;
+
+    BranchProbabilityInfo BPI;
+    BPI.calculate(F, LI);
+    BlockFrequencyInfo BFI(F, BPI, LI);
+
+    // Block frequencies relative to a single call of the function.
+    const double EntryFreq = BFI.getEntryFreq();
+    auto getFreq = [&BFI, EntryFreq](BasicBlock *BB) {
+        return BFI.getBlockFreq(BB).getFrequency() / EntryFreq;
+    };
+
+    // Weight of each edge of the alternate CFG, i.e the probability that a
+    // path at its source takes it. Fake edges from Entry start new paths, so
+    // they are weighted by the frequency of the segmented edges they replace,
+    // which is also the case for real edges from Entry since its frequency
+    // is 1. Edges within a collapsed region have no weight.
+    DenseMap<Edge, double> Weight;
+    auto &Segments = ACFG.getSegments();
+    for (auto &BB : F) {
+        SmallPtrSet<BasicBlock *, 4> Seen;
+        for (auto S = succ_begin(&BB), E = succ_end(&BB); S != E; S++) {
+            // The probability of an edge includes all the duplicate edges
+            // between the same blocks, e.g switch cases.
+            if (!Seen.insert(*S).second)
+                continue;
+            auto BP  = BPI.getEdgeProbability(&BB, *S);
+            double P = static_cast<double>(BP.getNumerator()) /
+                       BP.getDenominator();
+            Edge Ed = {&BB, *S};
+            if (Segments.count(Ed)) {
+                auto Halves = Segments.lookup(Ed);
+                if (SRC(Halves.first))
+                    Weight[Halves.first] += P;
+                if (SRC(Halves.second))
+                    Weight[Halves.second] += getFreq(&BB) * P;
+            } else if (ACFG.getEdges().count(Ed)) {
+                Weight[Ed] += P;
+            }
+        }
+    }
+
+    // Enumerate the paths in decreasing order of frequency with a best first
+    // search. The weights of edges which are not from Entry are at most 1, so
+    // a path is never more frequent than its prefixes and the first complete
+    // paths found are the most likely ones. Partial paths are kept as a tree
+    // of states and only rebuilt when they are complete.
+    struct State {
+        double Freq;
+        BasicBlock *BB;
+        PathIdTy Id;
+        size_t Parent;
+        bool Fake;
+    };
+    vector<State> States;
+    auto Cmp = [&States](size_t A, size_t B) {
+        return States[A].Freq < States[B].Freq;
+    };
+    priority_queue<size_t, vector<size_t>, decltype(Cmp)> Queue(Cmp);
+
+    States.push_back({1.0, Enc.Entry, Traits::get(0), 0, false});
+    Queue.push(0);
+
+    auto &FakeEdges = ACFG.getFakeEdges();
+    uint64_t Found = 0, pathFail = 0;
+    while (!Queue.empty() && Found < numEstimates) {
+        auto I = Queue.top();
+        Queue.pop();
+
+        auto *BB = States[I].BB;
+        if (!isFunctionExiting(BB)) {
+            for (auto *Tgt : ACFG.succs(BB)) {
+                Edge Ed = {BB, Tgt};
+                auto W  = Weight.lookup(Ed);
+                if (W == 0.0 || States.size() >= MaxStates)
+                    continue;
+                PathIdTy Id;
+                Traits::addOv(States[I].Id, ACFG[Ed], Id);
+                States.push_back({States[I].Freq * W, Tgt, Id, I,
+                                  FakeEdges.count(Ed) != 0});
+                Queue.push(States.size() - 1);
+            }
+            continue;
+        }
+
+        uint64_t Count = llround(States[I].Freq * CountScale);
+        if (Count == 0)
+            break;
+
+        vector<BasicBlock *> Sequence;
+        bool First = false, Last = States[I].Fake;
+        for (auto J = I; J != 0; J = States[J].Parent) {
+            Sequence.push_back(States[J].BB);
+            First = States[J].Fake;
+        }
+        Sequence.push_back(Enc.Entry);
+        reverse(Sequence.begin(), Sequence.end());
+
+        auto Type = static_cast<PathType>((I != 0 && First) |
+                                          ((I != 0 && Last) << 1));
+        auto Blocks = trimPath(make_pair(Type, Sequence));
+
+        if (auto NumIns = pathCheck(Blocks)) {
+            Outfile << Traits::toString(States[I].Id) << " " << Count << " ";
+            Outfile << static_cast<int>(Type) << " ";
+            Outfile << NumIns << " ";
+            printPath(Blocks, Outfile);
+            Outfile << "\n";
+            Found++;
+        } else {
+            pathFail++;
+        }
+        DEBUG(errs() << "Path ID: " << Traits::toString(States[I].Id)
+                     << " Freq: " << States[I].Freq << "\n");
+    }
+
+    if (States.size() >= MaxStates)
+        errs() << "Warning : path search truncated for " << F.getName()
+               << "\n";
+    errs() << "Estimated paths : " << Found << "\n";
+    DEBUG(errs() << "Path Check Fails : " << pathFail << "\n");
+}
+
+char EPPEstimate::ID = 0;
@@ -0,0 +1,59 @@
+#include "llvm/IR/Function.h"
+#include "llvm/Support/CommandLine.h"
+
+#include <string>
+
+using namespace llvm;
+using namespace std;
+
+// Options read by the encoder, shared by the tools which run it so that a
+// new option of EPPEncode only needs to be defined here.
+
+cl::OptionCategory NeedleOptionCategory("Needle Options",
+                                        "Options for the Needle Framework");
+
+cl::opt<bool> wideCounter(
+    "use-wide-counter",
+    cl::desc("Use wide (128 bit) counters. Only available on 64 bit systems"),
+    cl::value_desc("boolean"), cl::init(false), cl::cat(NeedleOptionCategory));
+
+cl::list<std::string> FunctionList("epp-fn", cl::value_desc("String"),
+                                   cl::desc("List of functions to instrument"),
+                                   cl::ZeroOrMore, cl::CommaSeparated,
+                                   cl::cat(NeedleOptionCategory));
+
+cl::opt<bool> autoCut(
+    "epp-auto-cut",
+    cl::desc("Add cut points to the CFG when the number of paths does not "
+             "fit in the path counter"),
+    cl::init(false), cl::cat(NeedleOptionCategory));
+
+cl::opt<bool> collapse(
+    "epp-collapse",
+    cl::desc("Do not profile paths through blocks which cannot be "
+             "accelerated, e.g indirect or external library calls"),
+    cl::init(false), cl::cat(NeedleOptionCategory));
+
+cl::opt<string> loopName(
+    "epp-loop",
+    cl::desc("Profile only the loop with this header block name or starting "
+             "at this [file:]line, the rest of the function is collapsed"),
+    cl::value_desc("header|line"), cl::init(""),
+    cl::cat(NeedleOptionCategory));
+
+cl::opt<string> encodingCache(
+    "epp-cache",
+    cl::desc("File used to share the path encoding between instrumentation "
+             "and decoding, disabled by default"),
+    cl::value_desc("filename"), cl::init(""),
+    cl::cat(NeedleOptionCategory));
+
+bool isTargetFunction(const Function &f,
+                      const cl::list<std::string> &FunctionList) {
+    if (f.isDeclaration())
+        return false;
+    for (auto &fname : FunctionList)
+        if (fname == f.getName())
+            return true;
+    return false;
+}
@@ -1,6 +1,7 @@
 #define DEBUG_TYPE "epp_profile"
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/Analysis/CFG.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/CallSite.h"
@@ -15,9 +16,12 @@
 
 #include "AltCFG.h"
 #include "Common.h"
+#include "EPPDecode.h"
 #include "EPPEncode.h"
 #include "EPPProfile.h"
+#include <algorithm>
 #include <cassert>
+#include <fstream>
 #include <tuple>
 #include <unordered_map>
 
@@ -29,6 +33,7 @@ extern cl::list<std::string> FunctionList;
 extern bool isTargetFunction(const Function &f,
                              const cl::list<std::string> &FunctionList);
 extern cl::opt<bool> wideCounter;
+extern cl::opt<string> pppFile;
 
 bool EPPProfile::doInitialization(Module &m) {
     assert(FunctionList.size() == 1 &&
@@ -42,11 +47,15 @@ bool EPPProfile::runOnModule(Module &module) {
     DEBUG(errs() << "Running Profile\n");
     auto &Ctx = module.getContext();
 
+    // The counter width follows the width of the path ids, which is wide
+    // either when requested or when the number of paths needs it.
+    bool Wide = wideCounter;
     for (auto &func : module) {
         if (isTargetFunction(func, FunctionList)) {
             LI        = &getAnalysis<LoopInfoWrapperPass>(func).getLoopInfo();
             auto &enc = getAnalysis<EPPEncode>(func);
-            instrument(func, enc);
+            Wide |= enc.isWide;
+            enc.visit([this, &func](auto &E) { instrument(func, E); });
         }
     }
 
@@ -59,7 +68,17 @@ bool EPPProfile::runOnModule(Module &module) {
     Function *printer = nullptr;
     Function *init    = nullptr;
 
-    if (wideCounter) {
+    // In preferential mode the table of paths is registered with the
+    // runtime by the constructor created in instrument.
+    if (!pppFile.empty()) {
+        printer = cast<Function>(module.getOrInsertFunction(
+            Wide ? "PaThPrOfIlInG_savePPP64" : "PaThPrOfIlInG_savePPP32",
+            voidTy, nullptr));
+        appendToGlobalDtors(module, printer, 0);
+        return true;
+    }
+
+    if (Wide) {
         printer = cast<Function>(module.getOrInsertFunction(
             "PaThPrOfIlInG_save64", voidTy, nullptr));
         init = cast<Function>(module.getOrInsertFunction("PaThPrOfIlInG_init64",
@@ -87,25 +106,254 @@ static SmallVector<BasicBlock *, 1> getFunctionExitBlocks(Function &F) {
     return R;
 }
 
-void EPPProfile::instrument(Function &F, EPPEncode &Enc) {
+// Compute the id of a path from its blocks, as listed in epp-sequences.txt
+// i.e without the fake Entry or Exit blocks. Returns false if the blocks do
+// not form a path in the alternate CFG.
+template <typename PathIdTy>
+static bool getPathId(Encoding<PathIdTy> &Enc, PathType Type,
+                      const vector<BasicBlock *> &Blocks, PathIdTy &Id) {
+    typedef PathIdTraits<PathIdTy> Traits;
+    auto &ACFG = Enc.ACFG;
+
+    vector<Edge> Edges;
+    if (Type == FIRO || Type == FIFO)
+        Edges.push_back({Enc.Entry, Blocks.front()});
+    for (size_t I = 1; I < Blocks.size(); I++)
+        Edges.push_back({Blocks[I - 1], Blocks[I]});
+    if (Type == RIFO || Type == FIFO)
+        Edges.push_back({Blocks.back(), Enc.Exit});
+
+    Id = Traits::get(0);
+    for (auto &E : Edges) {
+        if (!ACFG.getEdges().count(E))
+            return false;
+        Id = Id + ACFG[E];
+    }
+    return true;
+}
+
+// Read the paths to be profiled preferentially. Each line is either a path
+// id or a line from epp-sequences.txt, in which case the id is recomputed
+// from the blocks so that the list remains valid if the encoding changes.
+// Returns the ids sorted in ascending order.
+template <typename PathIdTy>
+static vector<PathIdTy> readPreferredPaths(Function &F,
+                                           Encoding<PathIdTy> &Enc) {
+    typedef PathIdTraits<PathIdTy> Traits;
+    ifstream InFile(pppFile.c_str(), ios::in);
+    if (!InFile.is_open())
+        report_fatal_error("Could not open preferred paths");
+
+    StringMap<BasicBlock *> Blocks;
+    for (auto &BB : F)
+        Blocks[BB.getName()] = &BB;
+
+    vector<PathIdTy> Ids;
+    string Line;
+    while (getline(InFile, Line)) {
+        SmallVector<StringRef, 16> Tokens;
+        StringRef(Line).split(Tokens, " ", -1, false);
+        if (Tokens.empty())
+            continue;
+
+        PathIdTy Id;
+        if (Tokens.size() == 1) {
+            if (!Traits::fromString(Tokens[0], Id, 10))
+                report_fatal_error("Invalid path id in preferred paths");
+            Ids.push_back(Id);
+            continue;
+        }
+
+        // Id, Freq, PType, Ops, Blocks...
+        unsigned Type = 0;
+        if (Tokens.size() < 5 || Tokens[2].getAsInteger(10, Type) ||
+            Type > FIFO)
+            report_fatal_error("Malformed line in preferred paths");
+
+        vector<BasicBlock *> Seq;
+        for (size_t I = 4; I < Tokens.size(); I++)
+            Seq.push_back(Blocks.lookup(Tokens[I]));
+
+        if (count(Seq.begin(), Seq.end(), nullptr) ||
+            !getPathId(Enc, static_cast<PathType>(Type), Seq, Id)) {
+            errs() << "Skipping unknown path " << Tokens[0] << "\n";
+            continue;
+        }
+
+        DEBUG(if (Tokens[0] != Traits::toString(Id)) errs()
+              << "Path " << Tokens[0] << " is now " << Traits::toString(Id)
+              << "\n");
+        Ids.push_back(Id);
+    }
+
+    sort(Ids.begin(), Ids.end(), [](const PathIdTy &A, const PathIdTy &B) {
+        return !Traits::ule(B, A);
+    });
+    Ids.erase(unique(Ids.begin(), Ids.end()), Ids.end());
+    return Ids;
+}
+
+// Place the keys in a table of 2^Bits slots with a hash and displace scheme.
+// The multiplicative hash of a key picks a bucket and a first slot, and the
+// displacement of the bucket is chosen so that all its keys land in free
+// slots. Buckets are placed largest first. Each slot holds the position of
+// its key plus one, or zero if it is empty, so that the runtime finds the
+// dense index of a path id with two loads and no search. Must match
+// lib/epp/RuntimePPP.cpp.
+static bool hashPreferred(const vector<uint64_t> &Keys, unsigned Bits,
+                          uint64_t Mult, vector<uint64_t> &Slots,
+                          vector<uint64_t> &Disp) {
+    uint64_t Size = 1ULL << Bits;
+    vector<vector<pair<uint64_t, uint64_t>>> Buckets(Size);
+    for (uint64_t I = 0; I < Keys.size(); I++) {
+        uint64_t H = Keys[I] * Mult;
+        Buckets[H >> (64 - Bits)].push_back({(H << Bits) >> (64 - Bits), I});
+    }
+
+    vector<uint64_t> Order(Size);
+    for (uint64_t B = 0; B < Size; B++)
+        Order[B] = B;
+    stable_sort(Order.begin(), Order.end(), [&Buckets](uint64_t A, uint64_t B) {
+        return Buckets[A].size() > Buckets[B].size();
+    });
+
+    Slots.assign(Size, 0);
+    Disp.assign(Size, 0);
+    for (auto B : Order) {
+        auto &Bucket = Buckets[B];
+        if (Bucket.empty())
+            break;
+        // Keys with the same first slot are never separated by a shared
+        // displacement, a different multiplier is needed.
+        vector<uint64_t> First;
+        for (auto &E : Bucket)
+            First.push_back(E.first);
+        sort(First.begin(), First.end());
+        if (adjacent_find(First.begin(), First.end()) != First.end())
+            return false;
+
+        uint64_t D = 0;
+        auto fits  = [&]() {
+            return all_of(Bucket.begin(), Bucket.end(),
+                          [&](const pair<uint64_t, uint64_t> &E) {
+                              return !Slots[E.first ^ D];
+                          });
+        };
+        while (D < Size && !fits())
+            D++;
+        if (D == Size)
+            return false;
+        Disp[B] = D;
+        for (auto &E : Bucket)
+            Slots[E.first ^ D] = E.second + 1;
+    }
+    return true;
+}
+
+// Emit the sorted table of preferred path ids, the hash table which maps
+// them to their position in it and a constructor which registers both with
+// the runtime. The runtime keeps a dense array of counts indexed by the
+// position of the id in the table.
+template <typename PathIdTy>
+static void insertPreferredTable(Function &F, Encoding<PathIdTy> &Enc,
+                                 IntegerType *CtrTy) {
+    typedef PathIdTraits<PathIdTy> Traits;
+    Module *M     = F.getParent();
+    auto &Ctx     = M->getContext();
+    auto *voidTy  = Type::getVoidTy(Ctx);
+    auto *Int64Ty = Type::getInt64Ty(Ctx);
+
+    auto Ids = readPreferredPaths(F, Enc);
+    errs() << "Preferred Paths : " << Ids.size() << "\n";
+
+    // Wide ids are folded to 64 bits before hashing, as in the runtime.
+    vector<Constant *> Elems;
+    vector<uint64_t> Keys;
+    for (auto &Id : Ids) {
+        auto V = Traits::toAPInt(Id);
+        Elems.push_back(ConstantInt::get(Ctx, V));
+        uint64_t Hi = V.getNumWords() > 1 ? V.getRawData()[1] : 0;
+        Keys.push_back(V.getRawData()[0] ^ Hi * 0x9e3779b97f4a7c15ULL);
+    }
+
+    // Start at a load of at most one half and grow the table if no
+    // multiplier places all the keys.
+    unsigned Bits = 1;
+    while ((1ULL << Bits) < 2 * Keys.size())
+        Bits++;
+    uint64_t Mult = 0x9e3779b97f4a7c15ULL;
+    vector<uint64_t> Slots, Disp;
+    for (unsigned Try = 1; !hashPreferred(Keys, Bits, Mult, Slots, Disp);
+         Try++) {
+        if (Try % 8 == 0)
+            Bits++;
+        if (Bits > 32)
+            report_fatal_error("Could not hash preferred paths");
+        Mult += 0x9e3779b97f4a7c16ULL;
+    }
+    DEBUG(errs() << "Preferred Slots : " << Slots.size() << "\n");
+
+    auto *ArrTy = ArrayType::get(CtrTy, Ids.size());
+    auto *Table = new GlobalVariable(*M, ArrTy, true,
+                                     GlobalValue::InternalLinkage,
+                                     ConstantArray::get(ArrTy, Elems),
+                                     "PaThPrOfIlInG_pppTable");
+    // The runtime reads the table as an array of native integers.
+    Table->setAlignment(16);
+
+    auto *HashTy  = ArrayType::get(Int64Ty, Slots.size());
+    auto *SlotTab = new GlobalVariable(
+        *M, HashTy, true, GlobalValue::InternalLinkage,
+        ConstantDataArray::get(Ctx, makeArrayRef(Slots)),
+        "PaThPrOfIlInG_pppSlots");
+    auto *DispTab = new GlobalVariable(
+        *M, HashTy, true, GlobalValue::InternalLinkage,
+        ConstantDataArray::get(Ctx, makeArrayRef(Disp)),
+        "PaThPrOfIlInG_pppDisp");
+
+    auto *Int64PtrTy = Int64Ty->getPointerTo();
+    auto *InitFn     = cast<Function>(M->getOrInsertFunction(
+        Traits::Width == 128 ? "PaThPrOfIlInG_initPPP64"
+                             : "PaThPrOfIlInG_initPPP32",
+        voidTy, CtrTy->getPointerTo(), Int64Ty, Int64PtrTy, Int64PtrTy,
+        Int64Ty, Int64Ty, nullptr));
+
+    auto *Ctor = Function::Create(FunctionType::get(voidTy, false),
+                                  GlobalValue::InternalLinkage,
+                                  "PaThPrOfIlInG_pppCtor", M);
+    IRBuilder<> Builder(BasicBlock::Create(Ctx, "entry", Ctor));
+    Builder.CreateCall(
+        InitFn, {Builder.CreateConstInBoundsGEP2_32(ArrTy, Table, 0, 0),
+                 ConstantInt::get(Int64Ty, Ids.size()),
+                 Builder.CreateConstInBoundsGEP2_32(HashTy, SlotTab, 0, 0),
+                 Builder.CreateConstInBoundsGEP2_32(HashTy, DispTab, 0, 0),
+                 ConstantInt::get(Int64Ty, Mult),
+                 ConstantInt::get(Int64Ty, Bits)});
+    Builder.CreateRetVoid();
+    appendToGlobalCtors(*M, Ctor, 0);
+}
+
+template <typename PathIdTy>
+void EPPProfile::instrument(Function &F, Encoding<PathIdTy> &Enc) {
+    typedef PathIdTraits<PathIdTy> Traits;
     Module *M    = F.getParent();
     auto &Ctx    = M->getContext();
     auto *voidTy = Type::getVoidTy(Ctx);
 
-    IntegerType *CtrTy = nullptr;
-    Constant *Zap      = nullptr;
-
-    if (wideCounter) {
-        CtrTy = Type::getInt128Ty(Ctx);
-        Zap   = ConstantInt::getIntegerValue(CtrTy, APInt(128, 0, true));
-    } else {
-        CtrTy = Type::getInt64Ty(Ctx);
-        Zap   = ConstantInt::getIntegerValue(CtrTy, APInt(64, 0, true));
-    }
+    // The increments are computed modulo the width of the path ids, so the
+    // counter has to be exactly as wide.
+    auto *CtrTy   = IntegerType::get(Ctx, Traits::Width);
+    Constant *Zap = ConstantInt::get(CtrTy, 0);
 
     Function *logFun = nullptr;
 
-    if (wideCounter) {
+    if (!pppFile.empty()) {
+        insertPreferredTable(F, Enc, CtrTy);
+        logFun = cast<Function>(M->getOrInsertFunction(
+            Traits::Width == 128 ? "PaThPrOfIlInG_logPathPPP64"
+                                 : "PaThPrOfIlInG_logPathPPP32",
+            voidTy, CtrTy, nullptr));
+    } else if (Traits::Width == 128) {
         logFun = cast<Function>(M->getOrInsertFunction(
             "PaThPrOfIlInG_logPath64", voidTy, CtrTy, nullptr));
     } else {
@@ -119,21 +367,16 @@ void EPPProfile::instrument(Function &F, EPPEncode &Enc) {
     auto *SI = new StoreInst(Zap, Ctr);
     SI->insertAfter(Ctr);
 
-    auto InsertInc = [&Ctr, &CtrTy](Instruction *addPos, APInt Increment) {
-        if (Increment.ne(APInt(128, 0, true))) {
-            DEBUG(errs() << "Inserting Increment " << Increment << " "
+    auto InsertInc = [&Ctr, &Ctx](Instruction *addPos, PathIdTy Increment) {
+        if (Increment != Traits::get(0)) {
+            DEBUG(errs() << "Inserting Increment "
+                         << Traits::toString(Increment) << " "
                          << addPos->getParent()->getName() << "\n");
 
             // Context Counter
             auto *LI = new LoadInst(Ctr, "ld.epp.ctr", addPos);
 
-            Constant *CI = nullptr;
-            if (wideCounter)
-                CI = ConstantInt::getIntegerValue(CtrTy, Increment);
-            else {
-                auto I64 = APInt(64, Increment.getLimitedValue(), true);
-                CI       = ConstantInt::getIntegerValue(CtrTy, I64);
-            }
+            auto *CI = ConstantInt::get(Ctx, Traits::toAPInt(Increment));
 
             auto *BI = BinaryOperator::CreateAdd(LI, CI);
             BI->insertAfter(LI);
@@ -141,7 +384,7 @@ void EPPProfile::instrument(Function &F, EPPEncode &Enc) {
         }
     };
 
-    auto InsertLogPath = [&logFun, &Ctr, &CtrTy, &Zap](BasicBlock *BB) {
+    auto InsertLogPath = [&logFun, &Ctr, &Zap](BasicBlock *BB) {
         auto logPos = BB->getTerminator();
         auto *LI    = new LoadInst(Ctr, "ld.epp.ctr", logPos);
         auto *CI    = CallInst::Create(logFun, {LI}, "");
@@ -162,6 +405,10 @@ void EPPProfile::instrument(Function &F, EPPEncode &Enc) {
         for (auto &I : *Tgt) {
             if (auto *Phi = dyn_cast<PHINode>(&I)) {
                 Phi->setIncomingBlock(blockIndex(Phi, Src), New);
+                // A switch may have several cases with the same target, all
+                // of them now reach it through the single edge from New.
+                while (Phi->getBasicBlockIndex(Src) != -1)
+                    Phi->removeIncomingValue(Src, false);
             }
         }
     };
@@ -189,48 +436,51 @@ void EPPProfile::instrument(Function &F, EPPEncode &Enc) {
     auto ExitBlocks = getFunctionExitBlocks(F);
     auto *Entry = &F.getEntryBlock(), *Exit = *ExitBlocks.begin();
 
-    CFGInstHelper Inst(Enc.ACFG, Entry, Exit);
+    CFGInstHelper<PathIdTy> Inst(Enc.ACFG, Entry, Exit);
 
-    APInt BackVal = APInt(128, 0, true);
+    auto BackVal = Traits::get(0);
 #define _ std::ignore
     tie(_, BackVal, _, _) = Inst.get({Exit, Entry});
 #undef _
 
-    DEBUG(errs() << "BackVal : " << BackVal.toString(10, true) << "\n");
+    DEBUG(errs() << "BackVal : " << Traits::toString(BackVal) << "\n");
 
-    SmallVector<Edge, 32> FunctionEdges;
     // For each edge in the function, get the increments
-    // for the edge and stick them in there.
+    // for the edge and stick them in there. Cases of a switch
+    // with the same target share an edge.
+    EdgeListTy FunctionEdges;
     for (auto &BB : F) {
         for (auto SB = succ_begin(&BB), SE = succ_end(&BB); SB != SE; SB++) {
-            FunctionEdges.push_back({&BB, *SB});
+            FunctionEdges.insert({&BB, *SB});
         }
     }
 
     for (auto &E : FunctionEdges) {
-        APInt Val1(128, 0, true), Val2(128, 0, true);
+        auto Val1 = Traits::get(0), Val2 = Traits::get(0);
         bool Exists = false, Log = false;
         tie(Exists, Val1, Log, Val2) = Inst.get(E);
 
         if (Exists) {
             auto *Split = interpose(SRC(E), TGT(E));
             if (Log) {
-                DEBUG(errs() << "Val1 : " << Val1.toString(10, true) << "\n");
-                DEBUG(errs() << "Val2 : " << Val2.toString(10, true) << "\n");
+                DEBUG(errs() << "Val1 : " << Traits::toString(Val1) << "\n");
+                DEBUG(errs() << "Val2 : " << Traits::toString(Val2) << "\n");
                 InsertInc(&*Split->getFirstInsertionPt(), Val1 + BackVal);
                 InsertLogPath(Split);
                 InsertInc(Split->getTerminator(), Val2);
             } else {
-                DEBUG(errs() << "Val1 : " << Val1.toString(10, true) << "\n");
+                DEBUG(errs() << "Val1 : " << Traits::toString(Val1) << "\n");
                 InsertInc(&*Split->getFirstInsertionPt(), Val1);
             }
         }
     }
 
     // Add the logpath function for all function exiting
-    // basic blocks.
+    // basic blocks. Paths which reach a collapsed exit were already
+    // logged when they entered the collapsed region.
     for (auto &EB : ExitBlocks) {
-        InsertLogPath(EB);
+        if (!Enc.Collapsed.count(EB))
+            InsertLogPath(EB);
     }
 }
 
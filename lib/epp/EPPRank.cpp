@@ -0,0 +1,100 @@
+#define DEBUG_TYPE "epp_rank"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include "EPPEncode.h"
+#include "EPPRank.h"
+
+#include <vector>
+
+using namespace llvm;
+using namespace epp;
+using namespace std;
+
+bool EPPRank::runOnModule(Module &M) {
+    auto &Ctx     = M.getContext();
+    auto *voidTy  = Type::getVoidTy(Ctx);
+    auto *Int32Ty = Type::getInt32Ty(Ctx);
+    auto *CharPtr = Type::getInt8PtrTy(Ctx);
+    auto *DblTy   = Type::getDoubleTy(Ctx);
+
+    vector<Function *> Funcs;
+    for (auto &F : M) {
+        if (F.isDeclaration() || F.hasAvailableExternallyLinkage())
+            continue;
+        Funcs.push_back(&F);
+    }
+
+    auto *EnterFn = cast<Function>(M.getOrInsertFunction(
+        "PaThPrOfIlInG_enterFn", voidTy, Int32Ty, nullptr));
+    auto *ExitFn = cast<Function>(M.getOrInsertFunction(
+        "PaThPrOfIlInG_exitFn", voidTy, Int32Ty, nullptr));
+
+    vector<Constant *> Names, NumPaths;
+    auto *Zero = ConstantInt::get(Int32Ty, 0);
+    for (uint32_t Id = 0; Id < Funcs.size(); Id++) {
+        auto *F  = Funcs[Id];
+        auto *LI = &getAnalysis<LoopInfoWrapperPass>(*F).getLoopInfo();
+        auto Paths = estimatePaths(*F, LI);
+        DEBUG(errs() << F->getName() << " : " << Paths << "\n");
+
+        auto *IdVal = ConstantInt::get(Int32Ty, Id);
+        CallInst::Create(EnterFn, {IdVal}, "",
+                         &*F->getEntryBlock().getFirstInsertionPt());
+        for (auto &BB : *F)
+            if (isa<ReturnInst>(BB.getTerminator()))
+                CallInst::Create(ExitFn, {IdVal}, "", BB.getTerminator());
+
+        auto *Str  = ConstantDataArray::getString(Ctx, F->getName());
+        auto *Name = new GlobalVariable(M, Str->getType(), true,
+                                        GlobalValue::PrivateLinkage, Str,
+                                        "PaThPrOfIlInG_fnName");
+        Names.push_back(ConstantExpr::getInBoundsGetElementPtr(
+            Str->getType(), Name, ArrayRef<Constant *>({Zero, Zero})));
+        NumPaths.push_back(ConstantFP::get(DblTy, Paths));
+    }
+
+    auto *NamesTy = ArrayType::get(CharPtr, Names.size());
+    auto *NamesGV = new GlobalVariable(M, NamesTy, true,
+                                       GlobalValue::InternalLinkage,
+                                       ConstantArray::get(NamesTy, Names),
+                                       "PaThPrOfIlInG_fnNames");
+    auto *PathsTy = ArrayType::get(DblTy, NumPaths.size());
+    auto *PathsGV = new GlobalVariable(M, PathsTy, true,
+                                       GlobalValue::InternalLinkage,
+                                       ConstantArray::get(PathsTy, NumPaths),
+                                       "PaThPrOfIlInG_fnPaths");
+
+    // Register the tables with the runtime before any other constructor
+    // may call an instrumented function.
+    auto *InitFn = cast<Function>(M.getOrInsertFunction(
+        "PaThPrOfIlInG_initRank", voidTy, Int32Ty, CharPtr->getPointerTo(),
+        DblTy->getPointerTo(), nullptr));
+    auto *Ctor = Function::Create(FunctionType::get(voidTy, false),
+                                  GlobalValue::InternalLinkage,
+                                  "PaThPrOfIlInG_rankCtor", &M);
+    auto *Entry = BasicBlock::Create(Ctx, "entry", Ctor);
+    Value *Args[] = {
+        ConstantInt::get(Int32Ty, Funcs.size()),
+        ConstantExpr::getInBoundsGetElementPtr(
+            NamesTy, NamesGV, ArrayRef<Constant *>({Zero, Zero})),
+        ConstantExpr::getInBoundsGetElementPtr(
+            PathsTy, PathsGV, ArrayRef<Constant *>({Zero, Zero}))};
+    CallInst::Create(InitFn, Args, "", Entry);
+    ReturnInst::Create(Ctx, Entry);
+    appendToGlobalCtors(M, Ctor, 0);
+
+    auto *SaveFn = cast<Function>(
+        M.getOrInsertFunction("PaThPrOfIlInG_saveRank", voidTy, nullptr));
+    appendToGlobalDtors(M, SaveFn, 0);
+
+    errs() << "Ranked Functions : " << Funcs.size() << "\n";
+    return true;
+}
+
+char EPPRank::ID = 0;
+static RegisterPass<EPPRank> X("", "EPPRank");
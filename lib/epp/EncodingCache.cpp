@@ -0,0 +1,91 @@
+#define DEBUG_TYPE "epp_encode"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "EncodingCache.h"
+
+#include <fstream>
+
+using namespace llvm;
+using namespace epp;
+using namespace std;
+
+// The cache is a text file with one record per function,
+//
+// function <name> <hash> <wide>
+// segments <N>
+// <src> <tgt>
+// paths <N>
+// <block> <numpaths>
+// weights <N>
+// <src> <tgt> <weight>
+
+static bool expect(ifstream &In, const char *Tag, uint64_t &N) {
+    string Str;
+    return (In >> Str >> N) && Str == Tag;
+}
+
+bool epp::readEncodingCache(StringRef Filename, EncodingCacheTy &Cache) {
+    ifstream In(Filename.str(), ios::in);
+    if (!In.is_open())
+        return false;
+
+    string Tag, Name;
+    while (In >> Tag >> Name) {
+        EncodingCacheEntry Entry;
+        uint64_t N = 0;
+        if (Tag != "function" || !(In >> Entry.Hash >> Entry.Wide))
+            return false;
+
+        if (!expect(In, "segments", N))
+            return false;
+        Entry.Segments.resize(N);
+        for (auto &S : Entry.Segments)
+            if (!(In >> S.first >> S.second))
+                return false;
+
+        if (!expect(In, "paths", N))
+            return false;
+        Entry.NumPaths.resize(N);
+        for (auto &P : Entry.NumPaths)
+            if (!(In >> P.first >> P.second))
+                return false;
+
+        if (!expect(In, "weights", N))
+            return false;
+        Entry.Weights.resize(N);
+        for (auto &W : Entry.Weights)
+            if (!(In >> get<0>(W) >> get<1>(W) >> get<2>(W)))
+                return false;
+
+        Cache[Name] = Entry;
+    }
+
+    DEBUG(errs() << "Read " << Cache.size() << " cached encodings\n");
+    return true;
+}
+
+void epp::writeEncodingCache(StringRef Filename, const EncodingCacheTy &Cache) {
+    ofstream Out(Filename.str(), ios::out);
+    if (!Out.is_open())
+        report_fatal_error("Could not write encoding cache");
+
+    for (auto &KV : Cache) {
+        auto &Entry = KV.second;
+        Out << "function " << KV.first << " " << Entry.Hash << " "
+            << Entry.Wide << "\n";
+
+        Out << "segments " << Entry.Segments.size() << "\n";
+        for (auto &S : Entry.Segments)
+            Out << S.first << " " << S.second << "\n";
+
+        Out << "paths " << Entry.NumPaths.size() << "\n";
+        for (auto &P : Entry.NumPaths)
+            Out << P.first << " " << P.second << "\n";
+
+        Out << "weights " << Entry.Weights.size() << "\n";
+        for (auto &W : Entry.Weights)
+            Out << get<0>(W) << " " << get<1>(W) << " " << get<2>(W) << "\n";
+    }
+}
@@ -0,0 +1,312 @@
+#define DEBUG_TYPE "epp_phase"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "PhaseDetect.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+using namespace epp;
+using namespace std;
+
+// Number of dimensions of the projected windows, the same as SimPoint.
+static const unsigned Dims = 15;
+
+// Number of random initializations of k-means for each number of phases,
+// the clustering with the smallest distortion is kept.
+static const unsigned NumInits = 5;
+
+static const unsigned MaxIterations = 100;
+
+// Largest number of windows clustered, larger traces are sampled.
+static const size_t MaxSample = 1 << 16;
+
+// Number of paths listed for each phase.
+static const unsigned PhasePaths = 10;
+
+typedef array<double, Dims> Point;
+
+namespace {
+
+struct Window {
+    uint64_t Index;
+    uint64_t Size;
+    vector<pair<string, uint64_t>> Paths;
+};
+
+struct Clustering {
+    vector<Point> Centers;
+    vector<unsigned> Assign;
+    double Distortion;
+};
+}
+
+static bool readWindow(ifstream &In, Window &W) {
+    string Line;
+    if (!getline(In, Line))
+        return false;
+    istringstream S(Line);
+    if (!(S >> W.Index >> W.Size))
+        report_fatal_error("Invalid window in trace windows");
+    W.Paths.clear();
+    string Pair;
+    while (S >> Pair) {
+        auto Pos = Pair.find(':');
+        uint64_t Count;
+        if (Pos == string::npos ||
+            StringRef(Pair).substr(Pos + 1).getAsInteger(10, Count))
+            report_fatal_error("Invalid path count in trace windows");
+        W.Paths.push_back({Pair.substr(0, Pos), Count});
+    }
+    return true;
+}
+
+static uint64_t mix(uint64_t X) {
+    X += 0x9e3779b97f4a7c15ULL;
+    X = (X ^ (X >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    X = (X ^ (X >> 27)) * 0x94d049bb133111ebULL;
+    return X ^ (X >> 31);
+}
+
+// The column of the projection matrix for a path, with values uniform in
+// [-1, 1]. It is derived from a hash of the path id so that the matrix does
+// not depend on the order in which the paths are seen.
+static Point project(StringRef Id) {
+    uint64_t H = 0xcbf29ce484222325ULL;
+    for (auto C : Id)
+        H = (H ^ static_cast<unsigned char>(C)) * 0x100000001b3ULL;
+    Point P;
+    for (unsigned D = 0; D < Dims; D++)
+        P[D] = static_cast<double>(mix(H ^ mix(D)) >> 11) / (1ULL << 52) - 1.0;
+    return P;
+}
+
+static double distance(const Point &A, const Point &B) {
+    double Sum = 0;
+    for (unsigned D = 0; D < Dims; D++)
+        Sum += (A[D] - B[D]) * (A[D] - B[D]);
+    return Sum;
+}
+
+static unsigned nearest(const Point &P, const vector<Point> &Centers) {
+    unsigned Best = 0;
+    for (unsigned J = 1; J < Centers.size(); J++)
+        if (distance(P, Centers[J]) < distance(P, Centers[Best]))
+            Best = J;
+    return Best;
+}
+
+// k-means with k-means++ seeding. There are fewer than K clusters if there
+// are fewer than K distinct points.
+static Clustering kmeans(const vector<Point> &Points, unsigned K,
+                         mt19937_64 &Rng) {
+    const size_t N = Points.size();
+    Clustering C;
+    C.Assign.assign(N, 0);
+
+    C.Centers.push_back(Points[Rng() % N]);
+    vector<double> Nearest(N, numeric_limits<double>::max());
+    while (C.Centers.size() < K) {
+        double Sum = 0;
+        for (size_t I = 0; I < N; I++) {
+            Nearest[I] =
+                min(Nearest[I], distance(Points[I], C.Centers.back()));
+            Sum += Nearest[I];
+        }
+        if (Sum == 0)
+            break;
+        // A point is picked with a probability proportional to the squared
+        // distance to its nearest center.
+        double R = uniform_real_distribution<double>(0, Sum)(Rng);
+        size_t I = 0;
+        for (; I + 1 < N && R >= Nearest[I]; I++)
+            R -= Nearest[I];
+        C.Centers.push_back(Points[I]);
+    }
+
+    vector<unsigned> Sizes;
+    for (unsigned Iter = 0; Iter < MaxIterations; Iter++) {
+        bool Changed = false;
+        for (size_t I = 0; I < N; I++) {
+            auto Best = nearest(Points[I], C.Centers);
+            Changed |= C.Assign[I] != Best;
+            C.Assign[I] = Best;
+        }
+        if (Iter && !Changed)
+            break;
+
+        // An empty cluster keeps its center.
+        Sizes.assign(C.Centers.size(), 0);
+        vector<Point> Sums(C.Centers.size(), Point());
+        for (size_t I = 0; I < N; I++) {
+            Sizes[C.Assign[I]]++;
+            for (unsigned D = 0; D < Dims; D++)
+                Sums[C.Assign[I]][D] += Points[I][D];
+        }
+        for (unsigned J = 0; J < C.Centers.size(); J++)
+            if (Sizes[J])
+                for (unsigned D = 0; D < Dims; D++)
+                    C.Centers[J][D] = Sums[J][D] / Sizes[J];
+    }
+
+    C.Distortion = 0;
+    for (size_t I = 0; I < N; I++)
+        C.Distortion += distance(Points[I], C.Centers[C.Assign[I]]);
+    return C;
+}
+
+// Bayesian Information Criterion of a clustering for the spherical
+// Gaussian model of X-means, which SimPoint uses to pick the number of
+// clusters.
+static double bic(const vector<Point> &Points, const Clustering &C) {
+    const double R = Points.size(), K = C.Centers.size();
+    if (R <= K)
+        return -numeric_limits<double>::max();
+
+    vector<double> Sizes(C.Centers.size(), 0);
+    for (auto A : C.Assign)
+        Sizes[A]++;
+
+    double Variance = max(C.Distortion / (Dims * (R - K)),
+                          numeric_limits<double>::min());
+    double Likelihood =
+        -R * Dims / 2 * log(2 * M_PI * Variance) - Dims * (R - K) / 2;
+    for (auto S : Sizes)
+        if (S)
+            Likelihood += S * log(S / R);
+    double Parameters = (K - 1) + Dims * K + 1;
+    return Likelihood - Parameters / 2 * log(R);
+}
+
+void epp::detectPhases(StringRef WindowFile, unsigned MaxPhases) {
+    ifstream In(WindowFile.str(), ios::in);
+    if (!In.is_open())
+        report_fatal_error("Could not open trace windows");
+
+    // The normalized path frequencies of each window after projection.
+    StringMap<Point> Columns;
+    vector<Point> Points;
+    Window W;
+    while (readWindow(In, W)) {
+        Point P = Point();
+        for (auto &KV : W.Paths) {
+            auto It = Columns.find(KV.first);
+            if (It == Columns.end())
+                It = Columns.insert({KV.first, project(KV.first)}).first;
+            double F = static_cast<double>(KV.second) / W.Size;
+            for (unsigned D = 0; D < Dims; D++)
+                P[D] += F * It->second[D];
+        }
+        Points.push_back(P);
+    }
+    if (Points.empty())
+        return;
+
+    // As in SimPoint, only a sample of the windows of a long trace is
+    // clustered and then every window is assigned to the nearest center.
+    mt19937_64 Rng(493575226);
+    vector<Point> Sample;
+    if (Points.size() > MaxSample) {
+        vector<size_t> Order(Points.size());
+        iota(Order.begin(), Order.end(), 0);
+        shuffle(Order.begin(), Order.end(), Rng);
+        for (size_t I = 0; I < MaxSample; I++)
+            Sample.push_back(Points[Order[I]]);
+    }
+    auto &Fit = Sample.empty() ? Points : Sample;
+
+    // The smallest number of phases whose score is within 90% of the range
+    // of scores, as in SimPoint.
+    vector<Clustering> Results;
+    vector<double> Scores;
+    for (unsigned K = 1; K <= MaxPhases && K <= Fit.size(); K++) {
+        Clustering Best;
+        for (unsigned I = 0; I < NumInits; I++) {
+            auto C = kmeans(Fit, K, Rng);
+            if (!I || C.Distortion < Best.Distortion)
+                Best = move(C);
+        }
+        Scores.push_back(bic(Fit, Best));
+        DEBUG(errs() << "Phases : " << K << " BIC : " << Scores.back()
+                     << "\n");
+        Results.push_back(move(Best));
+    }
+    auto Range = minmax_element(Scores.begin(), Scores.end());
+    double Threshold = *Range.first + 0.9 * (*Range.second - *Range.first);
+    unsigned Pick = 0;
+    while (Scores[Pick] < Threshold)
+        Pick++;
+    auto &C = Results[Pick];
+    if (!Sample.empty()) {
+        C.Assign.resize(Points.size());
+        for (size_t I = 0; I < Points.size(); I++)
+            C.Assign[I] = nearest(Points[I], C.Centers);
+    }
+
+    // Phases are numbered in the order they first appear in the trace.
+    vector<unsigned> Number(C.Centers.size(), ~0U);
+    unsigned NumPhases = 0;
+    for (auto A : C.Assign)
+        if (Number[A] == ~0U)
+            Number[A] = NumPhases++;
+    vector<size_t> Representative(NumPhases, 0);
+    vector<double> Closest(NumPhases, numeric_limits<double>::max());
+    for (size_t I = 0; I < Points.size(); I++) {
+        auto A = C.Assign[I];
+        auto D = distance(Points[I], C.Centers[A]);
+        if (D < Closest[Number[A]]) {
+            Closest[Number[A]]        = D;
+            Representative[Number[A]] = I;
+        }
+    }
+    errs() << "Phases : " << NumPhases << "\n";
+
+    // Second pass over the windows to add up the paths of each phase.
+    ofstream PhaseWindows("epp-phase-windows.txt", ios::out);
+    vector<StringMap<uint64_t>> Counts(NumPhases);
+    vector<uint64_t> Windows(NumPhases, 0), Executions(NumPhases, 0);
+    vector<uint64_t> Index;
+    In.clear();
+    In.seekg(0);
+    for (size_t I = 0; readWindow(In, W); I++) {
+        auto P = Number[C.Assign[I]];
+        PhaseWindows << P << "\n";
+        Windows[P]++;
+        Executions[P] += W.Size;
+        for (auto &KV : W.Paths)
+            Counts[P][KV.first] += KV.second;
+        Index.push_back(W.Index);
+    }
+
+    ofstream Out("epp-phases.txt", ios::out);
+    for (unsigned P = 0; P < NumPhases; P++) {
+        Out << P << " " << Windows[P] << " " << Executions[P] << " "
+            << Index[Representative[P]] << "\n";
+        vector<pair<uint64_t, StringRef>> Hot;
+        for (auto &KV : Counts[P])
+            Hot.push_back({KV.second, KV.first()});
+        auto Top = min<size_t>(PhasePaths, Hot.size());
+        partial_sort(Hot.begin(), Hot.begin() + Top, Hot.end(),
+                     [](const pair<uint64_t, StringRef> &A,
+                        const pair<uint64_t, StringRef> &B) {
+                         return A.first > B.first ||
+                                (A.first == B.first && A.second < B.second);
+                     });
+        for (size_t I = 0; I < Top; I++)
+            Out << (I ? " " : "") << Hot[I].second.str() << ":"
+                << Hot[I].first;
+        Out << "\n";
+    }
+}
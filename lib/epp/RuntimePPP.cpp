@@ -0,0 +1,132 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+extern "C" {
+
+// This macro allows us to prefix strings so that they are less likely to
+// conflict with existing symbol names in the examined programs.
+// e.g. EPP(entry) yields PaThPrOfIlInG_entry
+#define EPP(X) PaThPrOfIlInG_##X
+
+// Preferential path profiling. The instrumented program registers a sorted
+// table of the path ids of interest and a hash table built by the epp tool
+// which maps each of them to its position in the sorted table. Each logged
+// id is counted in a dense array by that position, ids which are not in the
+// table are only counted in aggregate.
+
+// The slot of a key, computed as in hashPreferred in lib/epp/EPPProfile.cpp.
+static inline uint64_t pppSlot(uint64_t Key, const uint64_t *Disp,
+                               uint64_t Mult, uint64_t Bits) {
+    uint64_t H = Key * Mult;
+    return ((H << Bits) >> (64 - Bits)) ^ Disp[H >> (64 - Bits)];
+}
+
+#ifdef __LP64__
+
+const unsigned __int128 *EPP(pppTable64) = nullptr;
+uint64_t EPP(pppSize64)                  = 0;
+uint64_t *EPP(pppCount64)                = nullptr;
+const uint64_t *EPP(pppSlots64)          = nullptr;
+const uint64_t *EPP(pppDisp64)           = nullptr;
+uint64_t EPP(pppMult64)                  = 0;
+uint64_t EPP(pppBits64)                  = 0;
+uint64_t EPP(pppOther64)                 = 0;
+
+void EPP(initPPP64)(const unsigned __int128 *Table, uint64_t Size,
+                    const uint64_t *Slots, const uint64_t *Disp, uint64_t Mult,
+                    uint64_t Bits) {
+    EPP(pppTable64) = Table;
+    EPP(pppSize64)  = Size;
+    EPP(pppSlots64) = Slots;
+    EPP(pppDisp64)  = Disp;
+    EPP(pppMult64)  = Mult;
+    EPP(pppBits64)  = Bits;
+    EPP(pppCount64) = (uint64_t *)calloc(Size + 1, sizeof(uint64_t));
+}
+
+void EPP(logPathPPP64)(unsigned __int128 Val) {
+    uint64_t Hi  = Val >> 64;
+    uint64_t Key = (uint64_t)Val ^ Hi * 0x9e3779b97f4a7c15ULL;
+    uint64_t I   = EPP(pppSlots64)[pppSlot(Key, EPP(pppDisp64), EPP(pppMult64),
+                                           EPP(pppBits64))];
+    if (I && EPP(pppTable64)[I - 1] == Val)
+        EPP(pppCount64)[I - 1] += 1;
+    else
+        EPP(pppOther64) += 1;
+}
+
+void EPP(savePPP64)() {
+    uint64_t Num = 0;
+    for (uint64_t I = 0; I < EPP(pppSize64); I++)
+        Num += EPP(pppCount64)[I] != 0;
+
+    FILE *fp = fopen("path-profile-results.txt", "w");
+    fprintf(fp, "%lu\n", Num);
+    for (uint64_t I = 0; I < EPP(pppSize64); I++) {
+        if (!EPP(pppCount64)[I])
+            continue;
+        uint64_t low  = (uint64_t)EPP(pppTable64)[I];
+        uint64_t high = (EPP(pppTable64)[I] >> 64);
+        fprintf(fp, "%016lx%016lx %lu\n", high, low, EPP(pppCount64)[I]);
+    }
+    fclose(fp);
+
+    fp = fopen("path-profile-other.txt", "w");
+    fprintf(fp, "%lu\n", EPP(pppOther64));
+    fclose(fp);
+    free(EPP(pppCount64));
+}
+
+#endif
+
+const uint64_t *EPP(pppTable32) = nullptr;
+uint64_t EPP(pppSize32)         = 0;
+uint64_t *EPP(pppCount32)       = nullptr;
+const uint64_t *EPP(pppSlots32) = nullptr;
+const uint64_t *EPP(pppDisp32)  = nullptr;
+uint64_t EPP(pppMult32)         = 0;
+uint64_t EPP(pppBits32)         = 0;
+uint64_t EPP(pppOther32)        = 0;
+
+void EPP(initPPP32)(const uint64_t *Table, uint64_t Size,
+                    const uint64_t *Slots, const uint64_t *Disp, uint64_t Mult,
+                    uint64_t Bits) {
+    EPP(pppTable32) = Table;
+    EPP(pppSize32)  = Size;
+    EPP(pppSlots32) = Slots;
+    EPP(pppDisp32)  = Disp;
+    EPP(pppMult32)  = Mult;
+    EPP(pppBits32)  = Bits;
+    EPP(pppCount32) = (uint64_t *)calloc(Size + 1, sizeof(uint64_t));
+}
+
+void EPP(logPathPPP32)(uint64_t Val) {
+    uint64_t I = EPP(pppSlots32)[pppSlot(Val, EPP(pppDisp32), EPP(pppMult32),
+                                         EPP(pppBits32))];
+    if (I && EPP(pppTable32)[I - 1] == Val)
+        EPP(pppCount32)[I - 1] += 1;
+    else
+        EPP(pppOther32) += 1;
+}
+
+void EPP(savePPP32)() {
+    uint64_t Num = 0;
+    for (uint64_t I = 0; I < EPP(pppSize32); I++)
+        Num += EPP(pppCount32)[I] != 0;
+
+    FILE *fp = fopen("path-profile-results.txt", "w");
+    fprintf(fp, "%lu\n", Num);
+    for (uint64_t I = 0; I < EPP(pppSize32); I++) {
+        if (!EPP(pppCount32)[I])
+            continue;
+        fprintf(fp, "%016lx %lu\n", EPP(pppTable32)[I], EPP(pppCount32)[I]);
+    }
+    fclose(fp);
+
+    fp = fopen("path-profile-other.txt", "w");
+    fprintf(fp, "%lu\n", EPP(pppOther32));
+    fclose(fp);
+    free(EPP(pppCount32));
+}
+}
@@ -35,7 +35,15 @@ void EPP(logPath64)(__int128 Val) {
     }
 }
 
-void EPP(save)() { fclose(fp64); }
+// The last run is only written at exit.
+void EPP(save64)() {
+    if (EPP(PathId64) != -1) {
+        uint64_t low  = (uint64_t)EPP(PathId64);
+        uint64_t high = (EPP(PathId64) >> 64);
+        fprintf(fp64, "%016lx%016lx %lu\n", high, low, EPP(Counter64));
+    }
+    fclose(fp64);
+}
 
 #endif
 
@@ -61,5 +69,9 @@ void EPP(logPath32)(uint64_t Val) {
     }
 }
 
-void EPP(save32)() { fclose(fp32); }
+void EPP(save32)() {
+    if (EPP(PathId32) != -1)
+        fprintf(fp32, "%016lx %lu\n", EPP(PathId32), EPP(Counter32));
+    fclose(fp32);
+}
 }
@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/time.h>
+#include <vector>
+
+extern "C" {
+
+// This macro allows us to prefix strings so that they are less likely to
+// conflict with existing symbol names in the examined programs.
+// e.g. EPP(entry) yields PaThPrOfIlInG_entry
+#define EPP(X) PaThPrOfIlInG_##X
+
+// Function ranking. Each instrumented function pushes its id on a shadow
+// stack when it is entered and pops it when it returns. A profiling timer
+// samples the stack, the function on top is charged exclusive time and
+// every function on the stack is charged inclusive time once per sample.
+// The program is assumed to be single threaded.
+
+static const uint32_t MaxDepth   = 1 << 16;
+static const long SampleInterval = 1000; // usec
+
+static uint32_t NumFns        = 0;
+static const char **FnNames   = nullptr;
+static const double *FnPaths  = nullptr;
+static uint64_t *Calls        = nullptr;
+static uint64_t *Inclusive    = nullptr;
+static uint64_t *Exclusive    = nullptr;
+static uint64_t *Stamp        = nullptr;
+static uint64_t Samples       = 0;
+static uint32_t Stack[MaxDepth];
+static volatile uint32_t Depth = 0;
+
+static void sample(int) {
+    uint32_t D = Depth;
+    D          = D < MaxDepth ? D : MaxDepth;
+    Samples++;
+    if (D == 0)
+        return;
+    Exclusive[Stack[D - 1]] += 1;
+    // Recursive functions appear several times on the stack.
+    for (uint32_t I = 0; I < D; I++) {
+        auto Id = Stack[I];
+        if (Stamp[Id] != Samples) {
+            Stamp[Id] = Samples;
+            Inclusive[Id] += 1;
+        }
+    }
+}
+
+static void setTimer(long Usec) {
+    struct itimerval T;
+    T.it_interval.tv_sec  = 0;
+    T.it_interval.tv_usec = Usec;
+    T.it_value            = T.it_interval;
+    setitimer(ITIMER_PROF, &T, nullptr);
+}
+
+void EPP(initRank)(uint32_t N, const char **Names, const double *Paths) {
+    NumFns    = N;
+    FnNames   = Names;
+    FnPaths   = Paths;
+    Calls     = (uint64_t *)calloc(N + 1, sizeof(uint64_t));
+    Inclusive = (uint64_t *)calloc(N + 1, sizeof(uint64_t));
+    Exclusive = (uint64_t *)calloc(N + 1, sizeof(uint64_t));
+    Stamp     = (uint64_t *)calloc(N + 1, sizeof(uint64_t));
+
+    struct sigaction SA;
+    SA.sa_handler = sample;
+    SA.sa_flags   = SA_RESTART;
+    sigemptyset(&SA.sa_mask);
+    sigaction(SIGPROF, &SA, nullptr);
+    setTimer(SampleInterval);
+}
+
+void EPP(enterFn)(uint32_t Id) {
+    if (!Calls)
+        return;
+    Calls[Id] += 1;
+    if (Depth < MaxDepth)
+        Stack[Depth] = Id;
+    Depth = Depth + 1;
+}
+
+void EPP(exitFn)(uint32_t Id) {
+    if (!Calls)
+        return;
+    // Frames skipped by longjmp or exceptions are popped as well.
+    while (Depth > 0 && Depth <= MaxDepth && Stack[Depth - 1] != Id)
+        Depth = Depth - 1;
+    if (Depth > 0)
+        Depth = Depth - 1;
+}
+
+void EPP(saveRank)() {
+    if (!Calls)
+        return;
+    setTimer(0);
+
+    std::vector<uint32_t> Order;
+    for (uint32_t I = 0; I < NumFns; I++)
+        if (Calls[I])
+            Order.push_back(I);
+    std::sort(Order.begin(), Order.end(), [](uint32_t A, uint32_t B) {
+        if (Inclusive[A] != Inclusive[B])
+            return Inclusive[A] > Inclusive[B];
+        if (Exclusive[A] != Exclusive[B])
+            return Exclusive[A] > Exclusive[B];
+        return Calls[A] > Calls[B];
+    });
+
+    FILE *fp = fopen("epp-rank.txt", "w");
+    fprintf(fp, "# samples %lu interval %ldus\n", Samples, SampleInterval);
+    fprintf(fp, "# function calls inclusive exclusive paths\n");
+    for (auto I : Order) {
+        fprintf(fp, "%s %lu %lu %lu %g\n", FnNames[I], Calls[I], Inclusive[I],
+                Exclusive[I], FnPaths[I]);
+    }
+    fclose(fp);
+}
+}
@@ -0,0 +1,183 @@
+#define DEBUG_TYPE "epp_replay"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Namer.h"
+#include "Sequences.h"
+#include "TraceReplay.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <string>
+
+using namespace llvm;
+using namespace epp;
+using namespace std;
+
+TraceReplay::TraceReplay(StringRef SeqFile, const vector<BasicBlock *> &B)
+    : Blocks(B), Start(~0U), End(~0U), Inside(false), Pos(0), Prev(~0U),
+      Entries(0), Successes(0) {
+    // The paths of the region by block number, blocks are named in text seq
+    // files and numbered by Namer in binary ones.
+    vector<vector<unsigned>> Paths;
+    if (common::isSequenceFile(SeqFile)) {
+        DenseMap<uint32_t, unsigned> Index;
+        for (unsigned I = 0; I < Blocks.size(); I++)
+            Index[getBlockId(Blocks[I])] = I;
+        common::SequenceReader In(SeqFile);
+        common::SequenceRecord R;
+        while (In.next(R)) {
+            Paths.emplace_back();
+            for (auto Id : R.Blocks) {
+                auto It = Index.find(Id);
+                if (It == Index.end())
+                    report_fatal_error("Unknown block in replayed region");
+                Paths.back().push_back(It->second);
+            }
+        }
+    } else {
+        StringMap<unsigned> Index;
+        for (unsigned I = 0; I < Blocks.size(); I++)
+            Index[Blocks[I]->getName()] = I;
+        ifstream In(SeqFile.str(), ios::in);
+        if (!In.is_open())
+            report_fatal_error("Could not open replayed region");
+        string Line;
+        SmallVector<StringRef, 16> Tokens;
+        while (getline(In, Line)) {
+            Tokens.clear();
+            SplitString(Line, Tokens);
+            if (Tokens.empty())
+                continue;
+            Paths.emplace_back();
+            for (unsigned T = 4; T < Tokens.size(); T++) {
+                auto It = Index.find(Tokens[T]);
+                if (It == Index.end())
+                    report_fatal_error("Unknown block in replayed region");
+                Paths.back().push_back(It->second);
+            }
+        }
+    }
+
+    // The paths of a braid share their first and last blocks. The guards
+    // of the outlined region only let execution follow the edges between
+    // consecutive blocks of its paths.
+    for (auto &P : Paths) {
+        if (P.empty())
+            continue;
+        Start = P.front();
+        End   = P.back();
+        for (unsigned I = 1; I < P.size(); I++)
+            Edges.insert({P[I - 1], P[I]});
+    }
+    if (Start == ~0U)
+        report_fatal_error("Replayed region has no blocks");
+    DEBUG(errs() << "Replay : " << Blocks[Start]->getName() << " -> "
+                 << Blocks[End]->getName() << "\n");
+}
+
+void TraceReplay::step(unsigned Block, vector<Event> &Events) {
+    if (Inside) {
+        if (Edges.count({Prev, Block}) && Block != Start) {
+            Pos++;
+            Prev = Block;
+            if (Block == End) {
+                Events.push_back({Succeed, 0, 0});
+                Inside = false;
+            }
+            return;
+        }
+        Events.push_back({Fail, Prev, Pos});
+        Inside = false;
+    }
+    if (Block == Start) {
+        Events.push_back({Enter, 0, 0});
+        Inside = true;
+        Pos    = 0;
+        if (Block == End) {
+            Events.push_back({Succeed, 0, 0});
+            Inside = false;
+        }
+    }
+    Prev = Block;
+}
+
+void TraceReplay::apply(const Event &E, uint64_t Times) {
+    switch (E.K) {
+    case Enter:
+        Entries += Times;
+        break;
+    case Succeed:
+        Successes += Times;
+        break;
+    case Fail:
+        Failures[{E.Guard, E.Pos}] += Times;
+        break;
+    }
+}
+
+void TraceReplay::run(const vector<unsigned> &Path, uint64_t Count) {
+    // The state at the start of each repetition only depends on the state
+    // at the start of the previous one, so once it repeats the events in
+    // between repeat as well and are counted without replaying them.
+    vector<Event> Events;
+    map<tuple<bool, unsigned, unsigned>, pair<uint64_t, size_t>> Seen;
+    for (uint64_t Rep = 0; Rep < Count; Rep++) {
+        auto Key = make_tuple(Inside, Pos, Prev);
+        auto It  = Seen.find(Key);
+        if (It != Seen.end()) {
+            uint64_t Len    = Rep - It->second.first;
+            uint64_t Cycles = (Count - Rep) / Len;
+            for (auto E = It->second.second; E < Events.size(); E++)
+                apply(Events[E], Cycles);
+            for (Rep += Cycles * Len; Rep < Count; Rep++)
+                for (auto B : Path)
+                    step(B, Events);
+            break;
+        }
+        Seen[Key] = {Rep, Events.size()};
+        for (auto B : Path)
+            step(B, Events);
+    }
+    for (auto &E : Events)
+        apply(E, 1);
+}
+
+void TraceReplay::write() const {
+    uint64_t NumFailures = 0, Rollback = 0;
+    vector<pair<uint64_t, pair<unsigned, unsigned>>> Guards;
+    for (auto &KV : Failures) {
+        NumFailures += KV.second;
+        // Blocks executed up to and including the guard.
+        Rollback += KV.second * (KV.first.second + 1);
+        Guards.push_back({KV.second, KV.first});
+    }
+    stable_sort(Guards.begin(), Guards.end(),
+                [](const pair<uint64_t, pair<unsigned, unsigned>> &A,
+                   const pair<uint64_t, pair<unsigned, unsigned>> &B) {
+                    return A.first > B.first;
+                });
+
+    auto percent = [this](uint64_t N) {
+        return Entries ? 100.0 * N / Entries : 0.0;
+    };
+    errs() << "Replay : " << Entries << " entries, " << Successes
+           << " successes, " << NumFailures << " failures\n";
+
+    ofstream Out("epp-replay.txt", ios::out);
+    Out << fixed << setprecision(2);
+    Out << "entries " << Entries << "\n";
+    Out << "success " << Successes << " " << percent(Successes) << "\n";
+    Out << "fail " << NumFailures << " " << percent(NumFailures) << "\n";
+    Out << "rollback " << Rollback << "\n";
+    for (auto &G : Guards)
+        Out << "guard " << Blocks[G.second.first]->getName().str() << " "
+            << G.second.second << " " << G.first << " " << percent(G.first)
+            << "\n";
+}
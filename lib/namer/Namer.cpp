@@ -1,4 +1,6 @@
 #include "Namer.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Metadata.h"
 #include <cassert>
 #include <string>
 
@@ -16,20 +18,37 @@ bool Namer::doInitialization(Module &M) {
     return false;
 }
 
+static const char *BlockIdKind = "needle.block.id";
+
 bool Namer::runOnModule(Module &M) {
     uint64_t Counter = 0;
+    auto *Int32Ty    = Type::getInt32Ty(M.getContext());
     for (auto &F : M) {
         if (isTargetFunction(F, FunctionList)) {
+            uint32_t Id = 0;
             for (auto &BB : F) {
                 if (BB.getName().str() == string("")) {
                     BB.setName(string("__unk__") + to_string(Counter));
                     Counter++;
                 }
+                auto *Num = ConstantAsMetadata::get(
+                    ConstantInt::get(Int32Ty, Id++));
+                BB.getTerminator()->setMetadata(
+                    BlockIdKind, MDNode::get(M.getContext(), {Num}));
             }
         }
     }
     return true;
 }
 
+uint32_t epp::getBlockId(const BasicBlock *BB) {
+    auto *T = BB->getTerminator();
+    auto *N = T ? T->getMetadata(BlockIdKind) : nullptr;
+    if (!N)
+        return ~0U;
+    auto *Num = mdconst::extract<ConstantInt>(N->getOperand(0));
+    return Num->getZExtValue();
+}
+
 char Namer::ID = 0;
 static RegisterPass<Namer> X("", "Namer");
@@ -2,6 +2,8 @@
 
 #include "NeedleOutliner.h"
 #include "Common.h"
+#include "Namer.h"
+#include "Sequences.h"
 #include "llvm/ADT/APInt.h"
 #include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/SmallVector.h"
@@ -52,6 +54,22 @@ extern cl::opt<ExtractType> ExtractAs;
 extern cl::opt<bool> DisableUndoLog;
 
 void NeedleOutliner::readSequences() {
+    if (common::isSequenceFile(SeqFilePath)) {
+        common::SequenceReader Reader(SeqFilePath);
+        common::SequenceRecord R;
+        while (Reader.next(R)) {
+            Path P;
+            P.Id    = R.Id;
+            P.Freq  = R.Freq;
+            P.PType = static_cast<PathType>(R.Type);
+            P.Ids   = R.Blocks;
+            Sequences.push_back(P);
+            if (ExtractAs == path)
+                break;
+        }
+        return;
+    }
+
     ifstream SeqFile(SeqFilePath.c_str(), ios::in);
     assert(SeqFile.is_open() && "Could not open file");
     string Line;
@@ -445,6 +463,42 @@ void NeedleOutliner::extractHelper(Function *StaticFunc, Function *GuardFunc,
         CI->setIsNoInline();
     };
 
+    // The condition under which the switch transfers control to one of the
+    // Targets, i.e the value matches one of their cases or none of the other
+    // cases if one of them is the default destination.
+    auto caseCondition = [&Context](SwitchInst *SI,
+                                    ArrayRef<BasicBlock *> Targets) {
+        auto isTarget = [&Targets](BasicBlock *BB) {
+            return find(Targets.begin(), Targets.end(), BB) != Targets.end();
+        };
+        bool Default = isTarget(SI->getDefaultDest());
+        Value *Cond  = nullptr;
+        for (auto Case : SI->cases()) {
+            if (isTarget(Case.getCaseSuccessor()) == Default)
+                continue;
+            auto *Cmp = new ICmpInst(SI, Default ? CmpInst::ICMP_NE
+                                                 : CmpInst::ICMP_EQ,
+                                     SI->getCondition(), Case.getCaseValue());
+            if (!Cond)
+                Cond = Cmp;
+            else if (Default)
+                Cond = BinaryOperator::CreateAnd(Cond, Cmp, "", SI);
+            else
+                Cond = BinaryOperator::CreateOr(Cond, Cmp, "", SI);
+        }
+        return Cond ? Cond : ConstantInt::get(Type::getInt1Ty(Context), 1);
+    };
+
+    // Guard the switch on the condition that it stays within Targets.
+    auto insertCaseGuard = [&GuardFunc, &Context, &caseCondition](
+        SwitchInst *SI, ArrayRef<BasicBlock *> Targets) {
+        vector<Value *> Params = {caseCondition(SI, Targets),
+                                  ConstantInt::getTrue(Context)};
+        auto CI = CallInst::Create(GuardFunc, Params, "", SI);
+        CI->setDoesNotAccessMemory();
+        CI->setIsNoInline();
+    };
+
     for (auto IT = next(RevTopoChop.begin()), IE = RevTopoChop.end(); IT != IE;
          IT++) {
         auto *NewBB = cast<BasicBlock>(VMap[*IT]);
@@ -456,10 +510,65 @@ void NeedleOutliner::extractHelper(Function *StaticFunc, Function *GuardFunc,
         assert(!isa<ReturnInst>(T) && "Should not occur");
         assert(!isa<UnreachableInst>(T) && "Should not occur");
 
-        if (isa<SwitchInst>(T)) {
-            assert(false &&
-                   "Switch instruction not handled, "
-                   "use LowerSwitchPass to convert switch to if-else.");
+        if (auto *SwInst = dyn_cast<SwitchInst>(T)) {
+            if (extractAsChop) {
+                // Keep the cases whose targets are in the chop, the guard
+                // covers the cases which leave it.
+                SmallVector<BasicBlock *, 4> Targets;
+                bool Leaves = false;
+                for (unsigned I = 0; I < T->getNumSuccessors(); I++) {
+                    auto BL = T->getSuccessor(I);
+                    if (inChop(BL) &&
+                        BackEdges.count(make_pair(*IT, BL)) == 0) {
+                        if (find(Targets.begin(), Targets.end(), BL) ==
+                            Targets.end())
+                            Targets.push_back(BL);
+                    } else {
+                        Leaves = true;
+                    }
+                }
+
+                assert(Targets.size() &&
+                       "At least one target should be in the chop");
+
+                if (Leaves)
+                    insertCaseGuard(SwInst, Targets);
+
+                if (Targets.size() == 1) {
+                    assert(VMap[Targets[0]] && "Value not found in map");
+                    T->eraseFromParent();
+                    BranchInst::Create(cast<BasicBlock>(VMap[Targets[0]]),
+                                       NewBB);
+                } else {
+                    SmallVector<ConstantInt *, 8> Removed;
+                    for (auto Case : SwInst->cases()) {
+                        auto *BL = Case.getCaseSuccessor();
+                        if (find(Targets.begin(), Targets.end(), BL) ==
+                            Targets.end()) {
+                            Removed.push_back(Case.getCaseValue());
+                        } else {
+                            assert(VMap[BL] && "Value not found in map");
+                            Case.setSuccessor(cast<BasicBlock>(VMap[BL]));
+                        }
+                    }
+                    for (auto *V : Removed)
+                        SwInst->removeCase(SwInst->findCaseValue(V));
+
+                    auto *BD = SwInst->getDefaultDest();
+                    if (find(Targets.begin(), Targets.end(), BD) ==
+                        Targets.end())
+                        BD = Targets[0];
+                    SwInst->setDefaultDest(cast<BasicBlock>(VMap[BD]));
+                }
+            } else {
+                // Trace keeps the single case which leads to the next block
+                // in the path, guarded on the case value.
+                auto *SuccBB = *prev(IT);
+                assert(VMap[SuccBB] && "Successor not found in VMap");
+                insertCaseGuard(SwInst, {SuccBB});
+                T->eraseFromParent();
+                BranchInst::Create(cast<BasicBlock>(VMap[SuccBB]), NewBB);
+            }
         } else if (auto *BrInst = dyn_cast<BranchInst>(T)) {
             if (extractAsChop) {
                 auto NS = T->getNumSuccessors();
@@ -1015,25 +1124,31 @@ Function *NeedleOutliner::extract(PostDominatorTree *PDT, Module *Mod,
 
     auto *LastT = LastBB->getTerminator();
 
-    switch (LastT->getNumSuccessors()) {
-    case 2: {
-        auto *CBR = dyn_cast<BranchInst>(LastT);
-        LiveOut.insert(CBR->getCondition());
-    } break;
-    case 1:
-        break;
-    case 0: {
-        auto *RT = dyn_cast<ReturnInst>(LastT);
-        assert(RT && "Path with 0 successor should have returninst");
-        auto *Val = RT->getReturnValue();
-        // This Val is added to the live out set only if it
-        // is def'ed in the extracted region.
-        if (Val != nullptr && isDefInOutlineBlocks(Val)) {
-            LiveOut.insert(Val);
+    // A switch is evaluated inside the success block the same way, its
+    // condition is needed whatever the number of successors.
+    if (auto *SI = dyn_cast<SwitchInst>(LastT)) {
+        LiveOut.insert(SI->getCondition());
+    } else {
+        switch (LastT->getNumSuccessors()) {
+        case 2: {
+            auto *CBR = dyn_cast<BranchInst>(LastT);
+            LiveOut.insert(CBR->getCondition());
+        } break;
+        case 1:
+            break;
+        case 0: {
+            auto *RT = dyn_cast<ReturnInst>(LastT);
+            assert(RT && "Path with 0 successor should have returninst");
+            auto *Val = RT->getReturnValue();
+            // This Val is added to the live out set only if it
+            // is def'ed in the extracted region.
+            if (Val != nullptr && isDefInOutlineBlocks(Val)) {
+                LiveOut.insert(Val);
+            }
+        } break;
+        default:
+            assert(false && "Unexpected num successors");
         }
-    } break;
-    default:
-        assert(false && "Unexpected num successors -- lowerswitch?");
     }
 
     // errs() << "LiveIns :\n";
@@ -1112,15 +1227,10 @@ Function *NeedleOutliner::extract(PostDominatorTree *PDT, Module *Mod,
     return StaticFunc;
 }
 
-static SetVector<BasicBlock *>
-getTraceBlocks(Path &P, map<string, BasicBlock *> &BlockMap) {
+static SetVector<BasicBlock *> getTraceBlocks(vector<BasicBlock *> &Seq) {
     SetVector<BasicBlock *> RPath;
-    for (auto RB = P.Seq.rbegin(), RE = P.Seq.rend(); RB != RE; RB++) {
-        if (BlockMap.count(*RB) == 0)
-            errs() << "Missing :" << *RB << "\n";
-        assert(BlockMap.count(*RB) && "Path does not exist");
-        RPath.insert(BlockMap[*RB]);
-    }
+    for (auto RB = Seq.rbegin(), RE = Seq.rend(); RB != RE; RB++)
+        RPath.insert(*RB);
     return RPath;
 }
 
@@ -1430,9 +1540,37 @@ void NeedleOutliner::process(Function &F) {
     auto *DT    = &getAnalysis<DominatorTreeWrapperPass>(F).getDomTree();
     auto *LI    = &getAnalysis<LoopInfoWrapperPass>(F).getLoopInfo();
 
+    // Blocks are looked up by name, or by the number given by Namer for
+    // sequences read from a binary file.
     map<string, BasicBlock *> BlockMap;
-    for (auto &BB : F)
+    vector<BasicBlock *> BlockIds;
+    for (auto &BB : F) {
         BlockMap[BB.getName().str()] = &BB;
+        auto Num = epp::getBlockId(&BB);
+        if (Num == ~0U)
+            continue;
+        if (Num >= BlockIds.size())
+            BlockIds.resize(Num + 1, nullptr);
+        BlockIds[Num] = &BB;
+    }
+
+    auto getBlocks = [&BlockMap, &BlockIds](Path &P) {
+        vector<BasicBlock *> Seq;
+        for (auto Num : P.Ids) {
+            if (Num >= BlockIds.size() || !BlockIds[Num])
+                errs() << "Missing :" << Num << "\n";
+            assert(Num < BlockIds.size() && BlockIds[Num] &&
+                   "Path does not exist");
+            Seq.push_back(BlockIds[Num]);
+        }
+        for (auto &Name : P.Seq) {
+            if (BlockMap.count(Name) == 0)
+                errs() << "Missing :" << Name << "\n";
+            assert(BlockMap.count(Name) && "Path does not exist");
+            Seq.push_back(BlockMap[Name]);
+        }
+        return Seq;
+    };
 
     SetVector<BasicBlock *> Blocks;
     std::string Id;
@@ -1440,16 +1578,16 @@ void NeedleOutliner::process(Function &F) {
         BasicBlock *Start = nullptr, *End = nullptr;
         DenseSet<BasicBlock *> MergeBlocks;
         for (auto &P : Sequences) {
+            auto Seq = getBlocks(P);
             if (Start == nullptr) {
-                Start = BlockMap[P.Seq.front()];
-                End   = BlockMap[P.Seq.back()];
+                Start = Seq.front();
+                End   = Seq.back();
                 Id    = P.Id;
             }
 
-            if (Start == BlockMap[P.Seq.front()] &&
-                End == BlockMap[P.Seq.back()]) {
-                for (auto BN : P.Seq)
-                    MergeBlocks.insert(BlockMap[BN]);
+            if (Start == Seq.front() && End == Seq.back()) {
+                for (auto *BB : Seq)
+                    MergeBlocks.insert(BB);
             }
         }
 
@@ -1458,9 +1596,10 @@ void NeedleOutliner::process(Function &F) {
 
     } else {
         assert(Sequences.size() == 1 && "Only 1 sequence for path");
-        auto &P = Sequences.front();
-        Id      = P.Id;
-        Blocks  = getTraceBlocks(P, BlockMap);
+        auto &P  = Sequences.front();
+        auto Seq = getBlocks(P);
+        Id       = P.Id;
+        Blocks   = getTraceBlocks(Seq);
     }
 
     Data["num-extract-blocks"] = Blocks.size();
@@ -0,0 +1,104 @@
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+
+#include "RegionCost.h"
+
+#include <algorithm>
+
+using namespace llvm;
+using namespace needle;
+using namespace std;
+
+typedef DenseSet<const BasicBlock *> BlockSet;
+
+// Operands which are not instructions are looked through as in
+// liveInHelper, an argument is a live-in and constants stay in the region.
+static void addLiveIn(const BlockSet &Region, DenseSet<const Value *> &LiveIn,
+                      const Value *V) {
+    if (auto *I = dyn_cast<Instruction>(V)) {
+        if (!Region.count(I->getParent()))
+            LiveIn.insert(I);
+    } else if (isa<Argument>(V)) {
+        LiveIn.insert(V);
+    } else if (auto *CE = dyn_cast<ConstantExpr>(V)) {
+        for (auto &Op : CE->operands())
+            addLiveIn(Region, LiveIn, Op);
+    }
+}
+
+// Each instruction takes a cycle once its operands are ready, values from
+// outside the path are ready on entry. Phis only select the value coming
+// from the previous block of the path.
+static uint64_t criticalPath(const vector<BasicBlock *> &Path) {
+    DenseMap<const Value *, uint64_t> Ready;
+    uint64_t Max = 0;
+    for (unsigned B = 0; B < Path.size(); B++) {
+        for (auto &I : *Path[B]) {
+            uint64_t Depth = 0;
+            if (auto *Phi = dyn_cast<PHINode>(&I)) {
+                if (B > 0)
+                    Depth = Ready.lookup(
+                        Phi->getIncomingValueForBlock(Path[B - 1]));
+            } else {
+                for (auto &Op : I.operands())
+                    Depth = max(Depth, Ready.lookup(Op));
+                Depth++;
+            }
+            Ready[&I] = Depth;
+            Max       = max(Max, Depth);
+        }
+    }
+    return Max;
+}
+
+RegionCost needle::getRegionCost(ArrayRef<vector<BasicBlock *>> Paths) {
+    RegionCost C = {0, 0, 0, 0, 0};
+    if (Paths.empty() || Paths.front().empty())
+        return C;
+
+    BlockSet Region;
+    for (auto &P : Paths) {
+        for (auto *BB : P)
+            Region.insert(BB);
+        C.CriticalPath = max(C.CriticalPath, criticalPath(P));
+    }
+    auto *Start = Paths.front().front();
+    DenseSet<const Value *> LiveIn, LiveOut;
+    for (auto *BB : Region) {
+        for (auto &I : *BB) {
+            C.Ops++;
+            if (isa<StoreInst>(&I))
+                C.UndoLog++;
+
+            // Used after the region, or in the next iteration of a loop
+            // through a phi of the first block.
+            for (auto *U : I.users()) {
+                auto *UI = dyn_cast<Instruction>(U);
+                if (UI && (!Region.count(UI->getParent()) ||
+                           (isa<PHINode>(UI) && UI->getParent() == Start)))
+                    LiveOut.insert(&I);
+            }
+
+            if (auto *Phi = dyn_cast<PHINode>(&I)) {
+                // The phis of the first block are evaluated before entering
+                // the region, the others only keep the values coming from
+                // inside the region.
+                if (BB == Start) {
+                    LiveIn.insert(Phi);
+                    continue;
+                }
+                for (unsigned K = 0; K < Phi->getNumIncomingValues(); K++)
+                    if (Region.count(Phi->getIncomingBlock(K)))
+                        addLiveIn(Region, LiveIn, Phi->getIncomingValue(K));
+            } else {
+                for (auto &Op : I.operands())
+                    addLiveIn(Region, LiveIn, Op);
+            }
+        }
+    }
+    C.LiveIn  = LiveIn.size();
+    C.LiveOut = LiveOut.size();
+    return C;
+}
@@ -22,7 +22,6 @@ bool Simplify::doFinalization(Module &M) { return false; }
 bool Simplify::runOnModule(Module &M) {
     for (auto &F : M) {
         if (F.getName() == FunctionName) {
-            common::lowerSwitch(F);
             common::breakCritEdges(F);
 
             auto updatePhis = [](BasicBlock *Tgt, BasicBlock *New) {
@@ -0,0 +1,174 @@
+#define DEBUG_TYPE "needle_epp_bench"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "EPPEncode.h"
+
+using namespace std;
+using namespace llvm;
+using namespace epp;
+
+cl::OptionCategory BenchOptionCategory("EPP Benchmark Options",
+                                       "Options for the encoding benchmark");
+
+cl::opt<unsigned> numLoops("loops", cl::desc("Number of loops to generate"),
+                           cl::value_desc("N"), cl::init(256),
+                           cl::cat(BenchOptionCategory));
+
+cl::opt<unsigned> numDiamonds("diamonds",
+                              cl::desc("Number of diamonds in each loop body"),
+                              cl::value_desc("N"), cl::init(16),
+                              cl::cat(BenchOptionCategory));
+
+cl::opt<unsigned> numRepeat("repeat", cl::desc("Number of times to encode"),
+                            cl::value_desc("N"), cl::init(3),
+                            cl::cat(BenchOptionCategory));
+
+cl::opt<unsigned>
+    numSizes("sweep",
+             cl::desc("Encode N functions, doubling the number of loops from "
+                      "-loops each time, and print the time per block of "
+                      "each so that the scaling can be checked"),
+             cl::value_desc("N"), cl::init(0), cl::cat(BenchOptionCategory));
+
+// The options of the encoder are defined in lib/epp/EPPOptions.cpp.
+extern cl::list<std::string> FunctionList;
+
+// Build a function with a sequence of loops. Each loop body is a chain of
+// diamonds followed by a latch, so the number of paths through a loop body is
+// 2^diamonds and the size of the CFG grows linearly with both parameters.
+static Function *buildSynthetic(Module &M, unsigned Loops, unsigned Diamonds) {
+    auto &Ctx = M.getContext();
+    auto *FTy = FunctionType::get(Type::getVoidTy(Ctx),
+                                  {Type::getInt1Ty(Ctx)}, false);
+    auto *F = Function::Create(FTy, GlobalValue::ExternalLinkage, "synthetic",
+                               &M);
+    Value *Cond = &*F->arg_begin();
+
+    auto *Entry = BasicBlock::Create(Ctx, "entry", F);
+    IRBuilder<> Builder(Entry);
+    auto *Prev = Entry;
+
+    for (unsigned L = 0; L < Loops; L++) {
+        auto Prefix = "l" + to_string(L);
+        auto *Header = BasicBlock::Create(Ctx, Prefix + ".header", F);
+        Builder.SetInsertPoint(Prev);
+        Builder.CreateBr(Header);
+
+        auto *Top = Header;
+        for (unsigned D = 0; D < Diamonds; D++) {
+            auto Name = Prefix + ".d" + to_string(D);
+            auto *Left  = BasicBlock::Create(Ctx, Name + ".left", F);
+            auto *Right = BasicBlock::Create(Ctx, Name + ".right", F);
+            auto *Join  = BasicBlock::Create(Ctx, Name + ".join", F);
+            Builder.SetInsertPoint(Top);
+            Builder.CreateCondBr(Cond, Left, Right);
+            Builder.SetInsertPoint(Left);
+            Builder.CreateBr(Join);
+            Builder.SetInsertPoint(Right);
+            Builder.CreateBr(Join);
+            Top = Join;
+        }
+
+        // Keep the back edge in its own block so that there are no
+        // critical edges in the generated CFG.
+        auto *Latch = BasicBlock::Create(Ctx, Prefix + ".latch", F);
+        auto *Exit  = BasicBlock::Create(Ctx, Prefix + ".exit", F);
+        Builder.SetInsertPoint(Top);
+        Builder.CreateCondBr(Cond, Latch, Exit);
+        Builder.SetInsertPoint(Latch);
+        Builder.CreateBr(Header);
+        Prev = Exit;
+    }
+
+    Builder.SetInsertPoint(Prev);
+    Builder.CreateRetVoid();
+    return F;
+}
+
+// Mean time to encode a synthetic function over numRepeat runs, or 0 if
+// numRepeat is 0. Each run is printed if Verbose.
+static double timeEncode(unsigned Loops, unsigned Diamonds, bool Verbose,
+                         uint64_t &NumBlocks, uint64_t &NumEdges) {
+    LLVMContext &context = getGlobalContext();
+    unique_ptr<Module> module(new Module("epp-bench", context));
+    auto *F = buildSynthetic(*module, Loops, Diamonds);
+    if (verifyFunction(*F, &errs()))
+        report_fatal_error("Generated function is malformed");
+
+    NumBlocks = F->size();
+    NumEdges  = 0;
+    for (auto &BB : *F)
+        NumEdges += BB.getTerminator()->getNumSuccessors();
+    if (Verbose) {
+        errs() << "Blocks : " << NumBlocks << "\n";
+        errs() << "Edges : " << NumEdges << "\n";
+    }
+
+    double Total = 0.0;
+    for (unsigned R = 0; R < numRepeat; R++) {
+        legacy::FunctionPassManager fpm(module.get());
+        fpm.add(new LoopInfoWrapperPass());
+        fpm.add(new EPPEncode());
+        fpm.doInitialization();
+
+        auto Start = chrono::steady_clock::now();
+        fpm.run(*F);
+        auto End = chrono::steady_clock::now();
+        fpm.doFinalization();
+
+        chrono::duration<double> Elapsed = End - Start;
+        Total += Elapsed.count();
+        if (Verbose)
+            errs() << "Run " << R << " : " << Elapsed.count() << "s\n";
+    }
+    return numRepeat ? Total / numRepeat : 0.0;
+}
+
+int main(int argc, char **argv, const char **env) {
+    sys::PrintStackTraceOnErrorSignal();
+    llvm::PrettyStackTraceProgram X(argc, argv);
+    llvm_shutdown_obj shutdown;
+
+    cl::ParseCommandLineOptions(argc, argv);
+
+    // The generated function is always called synthetic.
+    if (FunctionList.empty())
+        FunctionList.push_back("synthetic");
+
+    uint64_t NumBlocks, NumEdges;
+    if (!numSizes) {
+        auto Mean = timeEncode(numLoops, numDiamonds, true, NumBlocks,
+                               NumEdges);
+        if (numRepeat)
+            errs() << "Mean : " << Mean << "s\n";
+        return 0;
+    }
+
+    // The time per block stays flat if the encoding scales linearly.
+    outs() << "loops blocks edges mean us/block\n";
+    for (unsigned I = 0, Loops = numLoops; I < numSizes; I++, Loops *= 2) {
+        auto Mean = timeEncode(Loops, numDiamonds, false, NumBlocks, NumEdges);
+        outs() << Loops << " " << NumBlocks << " " << NumEdges << " "
+               << format("%.6f %.3f", Mean, Mean * 1e6 / NumBlocks) << "\n";
+    }
+
+    return 0;
+}
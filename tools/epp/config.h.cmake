@@ -3,6 +3,7 @@
 #define CONFIG_H
 
 #define RUNTIME_LIB "epp-rt"
+#define RANK_RUNTIME_LIB "epp-rt-rank"
 #cmakedefine CMAKE_TEMP_LIBRARY_PATH "@CMAKE_BINARY_DIR@/@CMAKE_BUILD_TYPE@/lib"
 
 #endif
@@ -46,7 +46,9 @@
 #include "AllInliner.h"
 #include "Common.h"
 #include "EPPDecode.h"
+#include "EPPEstimate.h"
 #include "EPPProfile.h"
+#include "EPPRank.h"
 #include "Namer.h"
 #include "Simplify.h"
 
@@ -60,8 +62,11 @@ using namespace epp;
 cl::opt<string> inPath(cl::Positional, cl::desc("<Module to analyze>"),
                        cl::value_desc("bitcode filename"), cl::Required);
 
-cl::OptionCategory NeedleOptionCategory("Needle Options",
-                                        "Options for the Needle Framework");
+// The options of the encoder are defined in lib/epp/EPPOptions.cpp.
+extern cl::OptionCategory NeedleOptionCategory;
+extern cl::list<std::string> FunctionList;
+extern bool isTargetFunction(const Function &f,
+                             const cl::list<std::string> &FunctionList);
 
 cl::opt<string> outFile("o", cl::desc("Filename of the instrumented program"),
                         cl::value_desc("filename"),
@@ -71,11 +76,6 @@ cl::opt<string> profile("p", cl::desc("Path to path profiling results"),
                         cl::value_desc("filename"),
                         cl::cat(NeedleOptionCategory));
 
-cl::opt<bool> wideCounter(
-    "use-wide-counter",
-    cl::desc("Use wide (128 bit) counters. Only available on 64 bit systems"),
-    cl::value_desc("boolean"), cl::init(false), cl::cat(NeedleOptionCategory));
-
 // Determine optimization level.
 cl::opt<char> optLevel("O",
                        cl::desc("Optimization level. [-O0, -O1, -O2, or -O3] "
@@ -90,22 +90,97 @@ cl::list<string> libraries("l", cl::Prefix,
                            cl::desc("Specify libraries to link to"),
                            cl::value_desc("library prefix"));
 
-cl::list<std::string> FunctionList("epp-fn", cl::value_desc("String"),
-                                   cl::desc("List of functions to instrument"),
-                                   cl::OneOrMore, cl::CommaSeparated,
-                                   cl::cat(NeedleOptionCategory));
+cl::opt<string> pppFile(
+    "epp-ppp",
+    cl::desc("Profile only the paths listed in the file (path ids or lines "
+             "from epp-sequences.txt), all others are counted together"),
+    cl::value_desc("filename"), cl::init(""), cl::cat(NeedleOptionCategory));
+
+cl::opt<bool> rankFunctions(
+    "rank",
+    cl::desc("Instrument all functions to rank them by execution time, the "
+             "instrumented program writes epp-rank.txt"),
+    cl::init(false), cl::cat(NeedleOptionCategory));
+
+cl::opt<unsigned> numEstimates(
+    "estimate",
+    cl::desc("Estimate the path frequencies statically instead of profiling, "
+             "the N most likely paths are written to epp-sequences.txt"),
+    cl::value_desc("N"), cl::init(0), cl::cat(NeedleOptionCategory));
+
+cl::opt<unsigned> numThreads(
+    "j", cl::desc("Number of threads used to decode the paths, 0 to use one "
+                  "per core"),
+    cl::value_desc("N"), cl::init(0), cl::cat(NeedleOptionCategory));
+
+cl::opt<unsigned> numTop(
+    "top",
+    cl::desc("Only decode the K paths with the highest coverage (count times "
+             "instructions) and write them in that order"),
+    cl::value_desc("K"), cl::init(0), cl::cat(NeedleOptionCategory));
+
+cl::opt<bool> binarySeq(
+    "seq-binary",
+    cl::desc("Write the decoded paths to epp-sequences.bin, with block "
+             "numbers instead of names"),
+    cl::init(false), cl::cat(NeedleOptionCategory));
+
+cl::opt<bool> traceProfile(
+    "trace",
+    cl::desc("The profile given with -p is a run length encoded trace "
+             "(path-profile-trace.txt) instead of aggregate counts"),
+    cl::init(false), cl::cat(NeedleOptionCategory));
+
+cl::opt<unsigned> traceWindow(
+    "trace-window",
+    cl::desc("Number of path executions in each window of "
+             "epp-trace-windows.txt, 0 to disable"),
+    cl::init(100000), cl::cat(NeedleOptionCategory));
+
+cl::opt<unsigned> numPhases(
+    "phases",
+    cl::desc("Cluster the windows of the trace into at most N phases and "
+             "write epp-phases.txt"),
+    cl::value_desc("N"), cl::init(0), cl::cat(NeedleOptionCategory));
+
+cl::opt<string> replayRegion(
+    "replay",
+    cl::desc("Replay the trace through the region of a seq file and write "
+             "its entries, successes and failures to epp-replay.txt"),
+    cl::value_desc("filename"), cl::init(""), cl::cat(NeedleOptionCategory));
+
+cl::opt<unsigned> decodeMemory(
+    "decode-mem",
+    cl::desc("Decode with about N MB for the decoded paths, sorted runs are "
+             "written to temporary files and merged"),
+    cl::value_desc("N"), cl::init(0), cl::cat(NeedleOptionCategory));
 
 cl::opt<bool> printSrcLines("src", cl::desc("Print Source Line Numbers"),
                             cl::init(false), cl::cat(NeedleOptionCategory));
 
-bool isTargetFunction(const Function &f,
-                      const cl::list<std::string> &FunctionList) {
-    if (f.isDeclaration())
-        return false;
-    for (auto &fname : FunctionList)
-        if (fname == f.getName())
-            return true;
-    return false;
+// Link the instrumented module with the runtime library into an executable.
+static void generateInstrumented(Module &module, std::string outFile,
+                                 const char *argv0, const char *runtime) {
+    // First search the directory of the binary for the library, in case it is
+    // all bundled together.
+    SmallString<32> invocationPath(argv0);
+    sys::path::remove_filename(invocationPath);
+    if (!invocationPath.empty()) {
+        libPaths.push_back(invocationPath.str());
+    }
+// If the builder doesn't plan on installing it, we still need to get to the
+// runtime library somehow, so just build in the path to the temporary one.
+#ifdef CMAKE_INSTALL_PREFIX
+    libPaths.push_back(CMAKE_INSTALL_PREFIX "/lib");
+#elif defined(CMAKE_TEMP_LIBRARY_PATH)
+    libPaths.push_back(CMAKE_TEMP_LIBRARY_PATH);
+#endif
+    libraries.push_back(runtime);
+    libraries.push_back("rt");
+    libraries.push_back("m");
+
+    common::saveModule(module, outFile + ".epp.bc");
+    common::generateBinary(module, outFile, optLevel, libPaths, libraries);
 }
 
 static void instrumentModule(Module &module, std::string outFile,
@@ -126,35 +201,24 @@ static void instrumentModule(Module &module, std::string outFile,
     pm.add(createVerifierPass());
     pm.run(module);
 
-    // First search the directory of the binary for the library, in case it is
-    // all bundled together.
-    SmallString<32> invocationPath(argv0);
-    sys::path::remove_filename(invocationPath);
-    if (!invocationPath.empty()) {
-        libPaths.push_back(invocationPath.str());
-    }
-// If the builder doesn't plan on installing it, we still need to get to the
-// runtime library somehow, so just build in the path to the temporary one.
-#ifdef CMAKE_INSTALL_PREFIX
-    libPaths.push_back(CMAKE_INSTALL_PREFIX "/lib");
-#elif defined(CMAKE_TEMP_LIBRARY_PATH)
-    libPaths.push_back(CMAKE_TEMP_LIBRARY_PATH);
-#endif
-    libraries.push_back(RUNTIME_LIB);
-    libraries.push_back("rt");
-    libraries.push_back("m");
+    generateInstrumented(module, outFile, argv0, RUNTIME_LIB);
+}
 
-    common::saveModule(module, outFile + ".epp.bc");
-    common::generateBinary(module, outFile, optLevel, libPaths, libraries);
+// Rank mode does not preprocess any function, the functions are instrumented
+// as they are so that their time is not skewed by inlining.
+static void rankModule(Module &module, std::string outFile,
+                       const char *argv0) {
+    legacy::PassManager pm;
+    pm.add(createLoopSimplifyPass());
+    pm.add(new LoopInfoWrapperPass());
+    pm.add(new epp::EPPRank());
+    pm.add(createVerifierPass());
+    pm.run(module);
+
+    generateInstrumented(module, outFile, argv0, RANK_RUNTIME_LIB);
 }
 
 static void interpretResults(Module &module, std::string filename) {
-    // We don't handle switch instructions, so convert
-    // them to if-else. This can also be done by the
-    // pass manager in epp/main.cpp however it breaks
-    // for some obscure function in 403.gcc. So here I
-    // only run it for my function of interest.
-
     legacy::PassManager pm;
     // pm.add(new DataLayoutPass());
     pm.add(new llvm::AssumptionCacheTracker());
@@ -171,6 +235,24 @@ static void interpretResults(Module &module, std::string filename) {
     pm.run(module);
 }
 
+// Same preprocessing as decoding, so that the estimated paths can be used
+// wherever decoded ones are.
+static void estimateResults(Module &module) {
+    legacy::PassManager pm;
+    pm.add(new llvm::AssumptionCacheTracker());
+    pm.add(createLoopSimplifyPass());
+    pm.add(createBasicAAWrapperPass());
+    pm.add(createTypeBasedAAWrapperPass());
+    pm.add(new llvm::CallGraphWrapperPass());
+    pm.add(new epp::PeruseInliner());
+    pm.add(new needle::Simplify(FunctionList[0]));
+    pm.add(new epp::Namer());
+    pm.add(new LoopInfoWrapperPass());
+    pm.add(new epp::EPPEstimate());
+    pm.add(createVerifierPass());
+    pm.run(module);
+}
+
 int main(int argc, char **argv, const char **env) {
     // This boilerplate provides convenient stack traces and clean LLVM exit
     // handling. It also initializes the built in support for convenient
@@ -188,6 +270,16 @@ int main(int argc, char **argv, const char **env) {
         TargetRegistry::printRegisteredTargetsForVersion);
     cl::ParseCommandLineOptions(argc, argv);
 
+    if (numTop && decodeMemory) {
+        errs() << "-top and -decode-mem cannot be used together!\n";
+        return -1;
+    }
+
+    if (traceProfile && decodeMemory) {
+        errs() << "-decode-mem cannot be used with -trace!\n";
+        return -1;
+    }
+
     // Construct an IR file from the filename passed on the command line.
     SMDiagnostic err;
     unique_ptr<Module> module = parseIRFile(inPath.getValue(), err, context);
@@ -199,16 +291,31 @@ int main(int argc, char **argv, const char **env) {
     }
 
     common::optimizeModule(module.get());
-    // These now happen inside the Simplify Pass
-    // common::lowerSwitch(*module, FunctionList[0]);
+    // This now happens inside the Simplify Pass
     // common::breakCritEdges(*module, FunctionList[0]);
 
-    if (!profile.empty()) {
+    if (rankFunctions) {
+        if (outFile.empty()) {
+            errs() << "-rank requires -o!\n";
+            return -1;
+        }
+        rankModule(*module, outFile, argv[0]);
+        return 0;
+    }
+
+    if (FunctionList.empty()) {
+        errs() << "No function selected with -epp-fn!\n";
+        return -1;
+    }
+
+    if (numEstimates) {
+        estimateResults(*module);
+    } else if (!profile.empty()) {
         interpretResults(*module, profile);
     } else if (!outFile.empty()) {
         instrumentModule(*module, outFile, argv[0]);
     } else {
-        errs() << "Neither -o nor -p were selected!\n";
+        errs() << "Neither -o, -p nor -estimate were selected!\n";
         return -1;
     }
 
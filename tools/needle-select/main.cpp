@@ -0,0 +1,706 @@
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Analysis/BasicAliasAnalysis.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/TypeBasedAliasAnalysis.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Scalar.h"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "AllInliner.h"
+#include "Common.h"
+#include "Namer.h"
+#include "RegionCost.h"
+#include "Sequences.h"
+#include "Simplify.h"
+
+using namespace std;
+using namespace llvm;
+
+// Selects the regions to outline from the decoded paths, epp-sequences.txt
+// or epp-sequences.bin, and writes them as seq files for needle. Paths are
+// ranked by their coverage, i.e frequency times instructions, and braids
+// (the paths with the same first and last block) by the sum of the coverage
+// of their paths. The input is streamed, paths need memory for the
+// candidates only and braids for a summary of each braid.
+
+enum SelectType { path, braid, regions, cost };
+
+cl::OptionCategory SelectOptionCategory("Needle Select Options",
+                                        "Options for region selection");
+
+cl::opt<string> InPath(cl::Positional, cl::desc("<Decoded paths>"),
+                       cl::value_desc("filename"),
+                       cl::init("epp-sequences.txt"),
+                       cl::cat(SelectOptionCategory));
+
+cl::opt<SelectType> SelectAs(
+    cl::desc("Choose region type, path/braid/regions/cost"),
+    cl::values(clEnumVal(path, "Select paths"),
+               clEnumVal(braid, "Select braids (merged paths)"),
+               clEnumVal(regions, "Select a set of paths and braids which do "
+                                  "not overlap and fit the budget"),
+               clEnumVal(cost, "Rank paths and braids by estimated cycles "
+                               "saved"),
+               clEnumValEnd),
+    cl::init(path), cl::cat(SelectOptionCategory));
+
+cl::opt<unsigned> NumCandidates("n", cl::desc("Number of regions to select"),
+                                cl::value_desc("N"), cl::init(5),
+                                cl::cat(SelectOptionCategory));
+
+cl::opt<string> ModulePath("bc",
+                           cl::desc("Module the paths were decoded from, "
+                                    "needed by -regions and -cost"),
+                           cl::value_desc("bitcode filename"), cl::init(""),
+                           cl::cat(SelectOptionCategory));
+
+cl::list<std::string> FunctionList("fn", cl::value_desc("String"),
+                                   cl::desc("Function the paths belong to"),
+                                   cl::ZeroOrMore, cl::CommaSeparated,
+                                   cl::cat(SelectOptionCategory));
+
+cl::opt<unsigned> MaxOps("max-ops",
+                         cl::desc("Largest total number of instructions of "
+                                  "the selected regions (0 for no limit)"),
+                         cl::value_desc("N"), cl::init(0),
+                         cl::cat(SelectOptionCategory));
+
+cl::opt<unsigned> MaxLiveIn("max-live-in",
+                            cl::desc("Largest total number of live-ins of the "
+                                     "selected regions (0 for no limit)"),
+                            cl::value_desc("N"), cl::init(0),
+                            cl::cat(SelectOptionCategory));
+
+cl::opt<unsigned> MaxUndo("max-undo",
+                          cl::desc("Largest total number of undo log entries "
+                                   "of the selected regions (0 for no limit)"),
+                          cl::value_desc("N"), cl::init(0),
+                          cl::cat(SelectOptionCategory));
+
+cl::opt<unsigned> OffloadCycles("offload-cycles",
+                                cl::desc("Cycles to invoke an offloaded "
+                                         "region, used by -cost"),
+                                cl::value_desc("N"), cl::init(10),
+                                cl::cat(SelectOptionCategory));
+
+// Number of nodes explored by the search for the best set of regions, once
+// reached the best set found so far is kept.
+static const uint64_t MaxNodes = 1 << 22;
+
+bool isTargetFunction(const Function &f,
+                      const cl::list<std::string> &FunctionList) {
+    if (f.isDeclaration())
+        return false;
+    for (auto &fname : FunctionList)
+        if (fname == f.getName())
+            return true;
+    return false;
+}
+
+// A line of epp-sequences.txt or a record of epp-sequences.bin. The blocks
+// of the binary format are numbers, they are kept as strings so that both
+// formats are handled alike.
+struct Sequence {
+    string Id;
+    uint64_t Freq;
+    uint64_t Ops;
+    vector<string> Blocks;
+
+    uint64_t coverage() const { return Freq * Ops; }
+};
+
+class SequenceInput {
+    ifstream Text;
+    unique_ptr<common::SequenceReader> Reader;
+
+  public:
+    SequenceInput(StringRef Filename) {
+        if (common::isSequenceFile(Filename)) {
+            Reader.reset(new common::SequenceReader(Filename));
+        } else {
+            Text.open(Filename.str(), ios::in);
+            if (!Text.is_open())
+                report_fatal_error("Could not open " + Filename);
+        }
+    }
+
+    bool next(Sequence &S) {
+        S.Blocks.clear();
+        if (Reader) {
+            common::SequenceRecord R;
+            if (!Reader->next(R))
+                return false;
+            S.Id   = R.Id;
+            S.Freq = R.Freq;
+            S.Ops  = R.NumIns;
+            if (R.Blocks.empty())
+                report_fatal_error("Path without blocks in sequence file");
+            for (auto B : R.Blocks)
+                S.Blocks.push_back(utostr(B));
+            return true;
+        }
+
+        string Line;
+        SmallVector<StringRef, 16> Tokens;
+        while (getline(Text, Line)) {
+            Tokens.clear();
+            SplitString(Line, Tokens);
+            if (Tokens.empty())
+                continue;
+            if (Tokens.size() < 5 || Tokens[1].getAsInteger(10, S.Freq) ||
+                Tokens[3].getAsInteger(10, S.Ops))
+                report_fatal_error(Twine("Invalid line in sequence file : ") +
+                                   Line);
+            S.Id = Tokens[0].str();
+            for (auto I = Tokens.begin() + 4; I != Tokens.end(); I++)
+                S.Blocks.push_back(I->str());
+            return true;
+        }
+        return false;
+    }
+};
+
+// A seq file for needle, in the format of the input. The type of each path
+// is written as 3 (FIFO) like the scripts this tool replaces did.
+class SequenceOutput {
+    ofstream Text;
+    unique_ptr<common::SequenceWriter> Writer;
+
+  public:
+    SequenceOutput(const string &Prefix, unsigned N, bool Binary) {
+        auto Name = Prefix + "-seq-" + utostr(N) + (Binary ? ".bin" : ".txt");
+        if (Binary)
+            Writer.reset(new common::SequenceWriter(Name));
+        else
+            Text.open(Name, ios::out);
+    }
+
+    void write(const Sequence &S) {
+        if (Writer) {
+            common::SequenceRecord R = {S.Id, S.Freq, 3, S.Ops, {}};
+            for (auto &B : S.Blocks)
+                R.Blocks.push_back(stoul(B));
+            Writer->write(R);
+            return;
+        }
+        Text << S.Id << " " << S.Freq << " 3 " << S.Ops << " ";
+        for (auto &B : S.Blocks)
+            Text << B << " ";
+        Text << "\n";
+    }
+};
+
+// The paths with the same first and last block.
+struct Braid {
+    uint64_t NumPaths;
+    uint64_t Ops;
+    uint64_t Blocks;
+    uint64_t Cov;
+    unsigned Order;
+    int Selected;
+    vector<Sequence> Paths;
+};
+
+static format_object<double> percent(uint64_t Cov, uint64_t Total) {
+    return format("%.2f", Total ? 100.0 * Cov / Total : 0.0);
+}
+
+// The N paths with the highest coverage, ties are broken by the order in
+// the input.
+static vector<Sequence> topPaths(unsigned N, uint64_t &Total) {
+    typedef pair<Sequence, uint64_t> Candidate;
+    auto Better = [](const Candidate &A, const Candidate &B) {
+        return A.first.coverage() > B.first.coverage() ||
+               (A.first.coverage() == B.first.coverage() &&
+                A.second < B.second);
+    };
+    // The worst candidate is at the top.
+    priority_queue<Candidate, vector<Candidate>, decltype(Better)> Heap(
+        Better);
+
+    SequenceInput In(InPath);
+    uint64_t Order = 0;
+    Sequence S;
+    Total = 0;
+    while (In.next(S)) {
+        Total += S.coverage();
+        Heap.push({S, Order++});
+        if (Heap.size() > N)
+            Heap.pop();
+    }
+
+    vector<Sequence> Paths;
+    for (; !Heap.empty(); Heap.pop())
+        Paths.push_back(Heap.top().first);
+    reverse(Paths.begin(), Paths.end());
+    return Paths;
+}
+
+// The N braids with the highest coverage. The first pass sums up each
+// braid, the second collects the paths of the selected braids in the order
+// of the input.
+static vector<Braid> topBraids(unsigned N, uint64_t &Total) {
+    auto key = [](const Sequence &S) {
+        return S.Blocks.front() + "|" + S.Blocks.back();
+    };
+
+    StringMap<Braid> Braids;
+    Total = 0;
+    {
+        SequenceInput In(InPath);
+        Sequence S;
+        while (In.next(S)) {
+            unsigned Order = Braids.size();
+            auto &B =
+                Braids.insert({key(S), {0, 0, 0, 0, Order, -1, {}}})
+                    .first->second;
+            B.NumPaths++;
+            B.Ops += S.Ops;
+            B.Blocks += S.Blocks.size();
+            B.Cov += S.coverage();
+            Total += S.coverage();
+        }
+    }
+
+    vector<Braid *> Sorted;
+    for (auto &KV : Braids)
+        Sorted.push_back(&KV.second);
+    auto Top = min<size_t>(N, Sorted.size());
+    partial_sort(Sorted.begin(), Sorted.begin() + Top, Sorted.end(),
+                 [](const Braid *A, const Braid *B) {
+                     return A->Cov > B->Cov ||
+                            (A->Cov == B->Cov && A->Order < B->Order);
+                 });
+    for (unsigned I = 0; I < Top; I++)
+        Sorted[I]->Selected = I;
+
+    SequenceInput In(InPath);
+    Sequence S;
+    while (In.next(S)) {
+        auto &B = Braids.find(key(S))->second;
+        if (B.Selected >= 0)
+            B.Paths.push_back(S);
+    }
+
+    vector<Braid> Result;
+    for (unsigned I = 0; I < Top; I++)
+        Result.push_back(move(*Sorted[I]));
+    return Result;
+}
+
+static void selectPaths(bool Binary) {
+    uint64_t Total;
+    auto Paths = topPaths(NumCandidates, Total);
+
+    // id : Path id
+    // fqs : Frequency of the path
+    // ops : Number of instructions in the path
+    // wt : Coverage fraction of the path
+    outs() << "id fqs ops wt\n";
+    for (unsigned N = 0; N < Paths.size(); N++) {
+        auto &P = Paths[N];
+        outs() << P.Id << " " << P.Freq << " " << P.Ops << " "
+               << percent(P.coverage(), Total) << "\n";
+        SequenceOutput("path", N, Binary).write(P);
+    }
+}
+
+static void selectBraids(bool Binary) {
+    uint64_t Total;
+    auto Braids = topBraids(NumCandidates, Total);
+
+    // id : Id of the first path in the braid
+    // len : Number of paths in the braid
+    // size1 : average size of paths in the braid (ops)
+    // size2 : average size of paths in the braid (blocks)
+    // wt : Coverage fraction of the braid
+    outs() << "id len size1 size2 wt\n";
+    for (unsigned N = 0; N < Braids.size(); N++) {
+        auto &B = Braids[N];
+        outs() << B.Paths.front().Id << " " << B.NumPaths << " "
+               << format("%.2f", static_cast<double>(B.Ops) / B.NumPaths)
+               << " "
+               << format("%.2f", static_cast<double>(B.Blocks) / B.NumPaths)
+               << " " << percent(B.Cov, Total) << "\n";
+        SequenceOutput Out("braid", N, Binary);
+        for (auto &P : B.Paths)
+            Out.write(P);
+    }
+}
+
+// Same preprocessing as decoding, so that the blocks of the module are
+// named and numbered as in the decoded paths.
+static unique_ptr<Module> loadModule(const char *Argv0) {
+    if (ModulePath.empty() || FunctionList.size() != 1) {
+        errs() << "-regions and -cost require -bc and a single -fn!\n";
+        return nullptr;
+    }
+    SMDiagnostic Err;
+    unique_ptr<Module> M(parseIRFile(ModulePath, Err, getGlobalContext()));
+    if (!M) {
+        errs() << "Error reading bitcode file.\n";
+        Err.print(Argv0, errs());
+        return nullptr;
+    }
+
+    common::optimizeModule(M.get());
+    legacy::PassManager PM;
+    PM.add(new llvm::AssumptionCacheTracker());
+    PM.add(createLoopSimplifyPass());
+    PM.add(createBasicAAWrapperPass());
+    PM.add(createTypeBasedAAWrapperPass());
+    PM.add(new llvm::CallGraphWrapperPass());
+    PM.add(new epp::PeruseInliner());
+    PM.add(new needle::Simplify(FunctionList[0]));
+    PM.add(new epp::Namer());
+    PM.run(*M);
+    return M;
+}
+
+namespace {
+
+// A path or a braid which may be selected along with others.
+struct Region {
+    bool IsBraid;
+    uint64_t Cov;
+    vector<Sequence> Paths;
+    DenseSet<BasicBlock *> Blocks;
+    needle::RegionCost Cost;
+    array<uint64_t, 3> Use;
+
+    Region(bool B, uint64_t C, vector<Sequence> P)
+        : IsBraid(B), Cov(C), Paths(move(P)) {}
+};
+
+// Branch and bound over the regions in decreasing order of coverage, a
+// region is either taken or not. The bound of a node is its coverage plus
+// the coverage of the remaining regions which still fit on their own.
+struct Search {
+    const vector<Region> &Regions;
+    const vector<BitVector> &Conflicts;
+    array<uint64_t, 3> Limit;
+
+    uint64_t Nodes = 0, Best = 0;
+    vector<unsigned> Chosen, BestSet;
+
+    Search(const vector<Region> &R, const vector<BitVector> &C,
+           array<uint64_t, 3> L)
+        : Regions(R), Conflicts(C), Limit(L) {}
+
+    bool fits(const array<uint64_t, 3> &Used, unsigned I) const {
+        for (unsigned K = 0; K < Used.size(); K++)
+            if (Used[K] + Regions[I].Use[K] > Limit[K])
+                return false;
+        return true;
+    }
+
+    void run(unsigned I, array<uint64_t, 3> Used, const BitVector &Blocked,
+             uint64_t Value) {
+        if (Value > Best) {
+            Best    = Value;
+            BestSet = Chosen;
+        }
+        if (I == Regions.size() || Nodes++ >= MaxNodes)
+            return;
+
+        uint64_t Bound = Value;
+        for (unsigned J = I; J < Regions.size(); J++)
+            if (!Blocked[J] && fits(Used, J))
+                Bound += Regions[J].Cov;
+        if (Bound <= Best)
+            return;
+
+        if (!Blocked[I] && fits(Used, I)) {
+            auto With = Used;
+            for (unsigned K = 0; K < With.size(); K++)
+                With[K] += Regions[I].Use[K];
+            auto WithBlocked = Blocked;
+            WithBlocked |= Conflicts[I];
+            Chosen.push_back(I);
+            run(I + 1, With, WithBlocked, Value + Regions[I].Cov);
+            Chosen.pop_back();
+        }
+        run(I + 1, Used, Blocked, Value);
+    }
+};
+}
+
+// Regions picked in decreasing order of coverage per share of the budget
+// they use, the starting point of the search.
+static vector<unsigned> greedy(const vector<Region> &Regions,
+                               const vector<BitVector> &Conflicts,
+                               const array<uint64_t, 3> &Limit,
+                               uint64_t &Value) {
+    auto density = [&Limit](const Region &R) {
+        double Share = 0;
+        for (unsigned K = 0; K < Limit.size(); K++)
+            if (Limit[K] != UINT64_MAX)
+                Share += static_cast<double>(R.Use[K]) / Limit[K];
+        return R.Cov / (1.0 + Share);
+    };
+    vector<unsigned> Order(Regions.size());
+    for (unsigned I = 0; I < Order.size(); I++)
+        Order[I] = I;
+    stable_sort(Order.begin(), Order.end(), [&](unsigned A, unsigned B) {
+        return density(Regions[A]) > density(Regions[B]);
+    });
+
+    vector<unsigned> Set;
+    array<uint64_t, 3> Used = {{0, 0, 0}};
+    BitVector Blocked(Regions.size());
+    Value = 0;
+    for (auto I : Order) {
+        bool Fits = !Blocked[I];
+        for (unsigned K = 0; Fits && K < Used.size(); K++)
+            Fits = Used[K] + Regions[I].Use[K] <= Limit[K];
+        if (!Fits)
+            continue;
+        for (unsigned K = 0; K < Used.size(); K++)
+            Used[K] += Regions[I].Use[K];
+        Blocked |= Conflicts[I];
+        Set.push_back(I);
+        Value += Regions[I].Cov;
+    }
+    sort(Set.begin(), Set.end());
+    return Set;
+}
+
+// The N best paths and the N best braids in decreasing order of coverage,
+// with their resources computed on the blocks of F.
+static vector<Region> candidates(Function &F, bool Binary, uint64_t &Total) {
+    StringMap<BasicBlock *> BlockMap;
+    for (auto &BB : F)
+        BlockMap[Binary ? utostr(epp::getBlockId(&BB)) : BB.getName().str()] =
+            &BB;
+
+    vector<Region> Regions;
+    for (auto &P : topPaths(NumCandidates, Total))
+        Regions.emplace_back(false, P.coverage(), vector<Sequence>{P});
+    for (auto &B : topBraids(NumCandidates, Total)) {
+        // A braid of a single path is the same region as the path.
+        auto Same = [&B](const Region &R) {
+            return R.Paths.front().Id == B.Paths.front().Id;
+        };
+        if (B.Paths.size() == 1 &&
+            any_of(Regions.begin(), Regions.end(), Same))
+            continue;
+        Regions.emplace_back(true, B.Cov, move(B.Paths));
+    }
+    stable_sort(Regions.begin(), Regions.end(),
+                [](const Region &A, const Region &B) { return A.Cov > B.Cov; });
+
+    for (auto &R : Regions) {
+        vector<vector<BasicBlock *>> Paths;
+        for (auto &P : R.Paths) {
+            Paths.emplace_back();
+            for (auto &Name : P.Blocks) {
+                auto It = BlockMap.find(Name);
+                if (It == BlockMap.end())
+                    report_fatal_error(Twine("Block ") + Name +
+                                       " not found in " + F.getName());
+                Paths.back().push_back(It->second);
+                R.Blocks.insert(It->second);
+            }
+        }
+        R.Cost = needle::getRegionCost(Paths);
+        R.Use  = {{R.Cost.Ops, R.Cost.LiveIn, R.Cost.UndoLog}};
+    }
+    return Regions;
+}
+
+static Function *targetFunction(Module &M) {
+    auto *F = M.getFunction(FunctionList[0]);
+    if (!F || F->isDeclaration())
+        report_fatal_error(Twine("Function ") + FunctionList[0] +
+                           " not found");
+    return F;
+}
+
+// The set of paths and braids with the largest coverage which do not share
+// any block and fit the budget.
+static int selectRegions(bool Binary, const char *Argv0) {
+    auto M = loadModule(Argv0);
+    if (!M)
+        return -1;
+    uint64_t Total;
+    auto Regions = candidates(*targetFunction(*M), Binary, Total);
+
+    vector<BitVector> Conflicts(Regions.size(), BitVector(Regions.size()));
+    for (unsigned I = 0; I < Regions.size(); I++)
+        for (unsigned J = I + 1; J < Regions.size(); J++)
+            for (auto *BB : Regions[I].Blocks)
+                if (Regions[J].Blocks.count(BB)) {
+                    Conflicts[I].set(J);
+                    Conflicts[J].set(I);
+                    break;
+                }
+
+    array<uint64_t, 3> Limit;
+    unsigned Budget[] = {MaxOps, MaxLiveIn, MaxUndo};
+    for (unsigned K = 0; K < Limit.size(); K++)
+        Limit[K] = Budget[K] ? Budget[K] : UINT64_MAX;
+
+    Search S(Regions, Conflicts, Limit);
+    S.BestSet = greedy(Regions, Conflicts, Limit, S.Best);
+    S.run(0, {{0, 0, 0}}, BitVector(Regions.size()), 0);
+    if (S.Nodes >= MaxNodes)
+        errs() << "Search stopped after " << S.Nodes
+               << " nodes, the selection may not be the best one\n";
+
+    // type : path or braid
+    // id : Id of the (first) path
+    // len : Number of paths
+    // ops : Number of instructions of the region
+    // livein : Number of live-in values
+    // undo : Number of undo log entries
+    // wt : Coverage fraction of the region
+    outs() << "type id len ops livein undo wt\n";
+    unsigned NumPaths = 0, NumBraids = 0;
+    uint64_t Cov = 0;
+    array<uint64_t, 3> Used = {{0, 0, 0}};
+    for (auto I : S.BestSet) {
+        auto &R = Regions[I];
+        outs() << (R.IsBraid ? "braid" : "path") << " " << R.Paths.front().Id
+               << " " << R.Paths.size() << " " << R.Use[0] << " " << R.Use[1]
+               << " " << R.Use[2] << " " << percent(R.Cov, Total) << "\n";
+        SequenceOutput Out(R.IsBraid ? "braid" : "path",
+                           R.IsBraid ? NumBraids++ : NumPaths++, Binary);
+        for (auto &P : R.Paths)
+            Out.write(P);
+        Cov += R.Cov;
+        for (unsigned K = 0; K < Used.size(); K++)
+            Used[K] += R.Use[K];
+    }
+    outs() << "total - " << S.BestSet.size() << " " << Used[0] << " "
+           << Used[1] << " " << Used[2] << " " << percent(Cov, Total) << "\n";
+    return 0;
+}
+
+// Executions of each block over all the paths.
+static StringMap<uint64_t> blockCounts() {
+    StringMap<uint64_t> Counts;
+    SequenceInput In(InPath);
+    Sequence S;
+    while (In.next(S))
+        for (auto &B : S.Blocks)
+            Counts[B] += S.Freq;
+    return Counts;
+}
+
+// The candidates ranked by the cycles they are expected to save. The region
+// is invoked each time its first block executes and succeeds when one of
+// its paths follows, which saves the cycles of that path on the host (one
+// per instruction). Each invocation costs the critical path of the region,
+// the offload overhead and the transfer of the live-ins, a success the
+// transfer of the live-outs and a failure the rollback of the undo log.
+static int rankRegions(bool Binary, const char *Argv0) {
+    auto M = loadModule(Argv0);
+    if (!M)
+        return -1;
+    uint64_t Total;
+    auto Regions = candidates(*targetFunction(*M), Binary, Total);
+    auto Counts  = blockCounts();
+
+    struct Estimate {
+        unsigned Index;
+        double Success;
+        double Saved;
+    };
+    vector<Estimate> Estimates;
+    for (unsigned I = 0; I < Regions.size(); I++) {
+        auto &R       = Regions[I];
+        uint64_t Freq = 0;
+        for (auto &P : R.Paths)
+            Freq += P.Freq;
+        auto Entries =
+            max(Freq, Counts.lookup(R.Paths.front().Blocks.front()));
+        double Invoke = R.Cost.CriticalPath + OffloadCycles + R.Cost.LiveIn;
+        double Saved  = static_cast<double>(R.Cov) - Entries * Invoke -
+                       static_cast<double>(Freq) * R.Cost.LiveOut -
+                       static_cast<double>(Entries - Freq) * R.Cost.UndoLog;
+        Estimates.push_back(
+            {I, Entries ? static_cast<double>(Freq) / Entries : 0, Saved});
+    }
+    stable_sort(Estimates.begin(), Estimates.end(),
+                [](const Estimate &A, const Estimate &B) {
+                    return A.Saved > B.Saved;
+                });
+
+    // type : path or braid
+    // id : Id of the (first) path
+    // len : Number of paths
+    // succ : Percentage of the executions of the first block which stay in
+    //        the region
+    // crit : Critical path of the region
+    // livein, liveout : Number of live values
+    // undo : Number of undo log entries
+    // wt : Coverage fraction of the region
+    // saved : Estimated cycles saved
+    outs() << "type id len succ crit livein liveout undo wt saved\n";
+    unsigned NumPaths = 0, NumBraids = 0;
+    for (auto &E : Estimates) {
+        auto &R = Regions[E.Index];
+        outs() << (R.IsBraid ? "braid" : "path") << " " << R.Paths.front().Id
+               << " " << R.Paths.size() << " "
+               << format("%.2f", 100 * E.Success) << " "
+               << R.Cost.CriticalPath << " " << R.Cost.LiveIn << " "
+               << R.Cost.LiveOut << " " << R.Cost.UndoLog << " "
+               << percent(R.Cov, Total) << " " << format("%.0f", E.Saved)
+               << "\n";
+        // Only the regions worth outlining are written.
+        if (E.Saved <= 0)
+            continue;
+        SequenceOutput Out(R.IsBraid ? "braid" : "path",
+                           R.IsBraid ? NumBraids++ : NumPaths++, Binary);
+        for (auto &P : R.Paths)
+            Out.write(P);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv, const char **env) {
+    sys::PrintStackTraceOnErrorSignal();
+    llvm::PrettyStackTraceProgram X(argc, argv);
+    llvm_shutdown_obj shutdown;
+
+    cl::ParseCommandLineOptions(argc, argv);
+
+    bool Binary = common::isSequenceFile(InPath);
+    switch (SelectAs) {
+    case path:
+        selectPaths(Binary);
+        break;
+    case braid:
+        selectBraids(Binary);
+        break;
+    case regions:
+        return selectRegions(Binary, argv[0]);
+    case cost:
+        return rankRegions(Binary, argv[0]);
+    }
+
+    return 0;
+}